@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include "pool.h"
 #include "avl.h"
 
 /************************************************
@@ -17,25 +18,36 @@
  *
  * - h: height of node.
  *
+ * - sz: amount of nodes in the subtree.
+ *
  * - el: element associated to node.
  *************************************************/
 struct AVL {
 	struct AVL *l, *r;
-	int h;
+	int h, sz;
 	void* el;
 };
 
+/*
+ * AVL NEW POOL: Creates a pool the AVL nodes can
+ *    be allocated from.
+ */
+struct Pool* avl_new_pool() {
+	return pool_new(sizeof(struct AVL));
+}
+
 /*
  * NEW NODE: Creates a new AVL tree node.
  */
-struct AVL* new_node(void* el, struct AVL* l, struct AVL* r) {
-	struct AVL* n = malloc(sizeof(struct AVL));
+struct AVL* new_node(void* el, struct AVL* l, struct AVL* r, struct Pool* pool) {
+	struct AVL* n = pool_alloc(pool);
 	if (n == NULL)
 		return NULL;
 	n->el = el;
 	n->l = l;
 	n->r = r;
 	n->h = 1;
+	n->sz = 1;
 	return n;
 }
 
@@ -49,8 +61,26 @@ int height(struct AVL* n) {
 }
 
 /*
- * COMPUTE HEIGHT: Calculates the height by
- *    looking at the node's children.
+ * SIZE: Returns the amount of nodes in the
+ *    subtree of a given node.
+ */
+int size(struct AVL* n) {
+	if (n == NULL)
+		return 0;
+	return n->sz;
+}
+
+/*
+ * COMPUTE SIZE: Calculates the size by looking
+ *    at the node's children.
+ */
+void compute_size(struct AVL* n) {
+	n->sz = size(n->l) + size(n->r) + 1;
+}
+
+/*
+ * COMPUTE HEIGHT: Calculates the height and size
+ *    by looking at the node's children.
  */
 void compute_height(struct AVL* n) {
 	int hl, hr;
@@ -58,6 +88,7 @@ void compute_height(struct AVL* n) {
 	hl = height(n->l);
 	hr = height(n->r);
 	n->h = hl > hr ? hl + 1 : hr + 1;
+	compute_size(n);
 }
 
 /*
@@ -125,8 +156,8 @@ int balance_factor(struct AVL* n) {
  * MAX: Returns the max value in the AVL.
  */
 struct AVL* max(struct AVL* n) {
-	while(n != NULL && n->r != NULL)
-		n = max(n->r);
+	while (n != NULL && n->r != NULL)
+		n = n->r;
 	return n;
 }
 
@@ -158,71 +189,251 @@ struct AVL* balance(struct AVL* n) {
 	return n;
 }
 
+/*
+ * AVL MIN: Returns the smallest element in the
+ *    AVL, or NULL if it's empty.
+ */
+void* avl_min(struct AVL* n) {
+	if (n == NULL)
+		return NULL;
+	while (n->l != NULL)
+		n = n->l;
+	return n->el;
+}
+
 /*
  * AVL FIND: Returns the element associated to the
  *    node found using a given both the key and a
  *    comparison function.
  */
 void* avl_find(struct AVL* n, void* k, int (*cmp_key_el)(void*, void*)) {
-	if (n == NULL)
-		return NULL;
+	int cmp;
 
-	if (cmp_key_el(k, n->el) == 0)
-		return n->el;
-	else if (cmp_key_el(k, n->el) < 0)
-		return avl_find(n->l, k, cmp_key_el);
-	else
-		return avl_find(n->r, k, cmp_key_el);
+	while (n != NULL) {
+		cmp = cmp_key_el(k, n->el);
+		if (cmp == 0)
+			return n->el;
+		n = cmp < 0 ? n->l : n->r;
+	}
+
+	return NULL;
+}
+
+/*
+ * FIX PATH: Balances the nodes linked from the
+ *    given path of links, from the deepest one
+ *    up. Once a subtree keeps its height the ones
+ *    above it only need their size updated.
+ */
+void fix_path(struct AVL** path[], int k) {
+	int h;
+
+	while (k-- > 0) {
+		h = height(*path[k]);
+		*path[k] = balance(*path[k]);
+		if (height(*path[k]) == h)
+			break;
+	}
+	while (k-- > 0)
+		compute_size(*path[k]);
 }
 
 /*
  * AVL INSERT: Insert a given element into the AVL
- *    using a given comparison function.
+ *    using a given comparison function. Returns
+ *    NULL if it fails to allocate memory.
  */
-struct AVL* avl_insert(struct AVL* n, void* el, int (*cmp_els)(void*, void*)) {
-	if (n == NULL)
-		return new_node(el, NULL, NULL);
+struct AVL* avl_insert(struct AVL* n, void* el, int (*cmp_els)(void*, void*),
+                                                          struct Pool* pool) {
+	struct AVL** path[AVL_MAX_HEIGHT];
+	struct AVL** link = &n;
+	int k = 0;
+
+	/* Keep the links followed down to the new leaf */
+	while (*link != NULL) {
+		path[k++] = link;
+		link = cmp_els(el, (*link)->el) < 0 ? &(*link)->l : &(*link)->r;
+	}
 
-	if (cmp_els(el, n->el) < 0) {
-		n->l = avl_insert(n->l, el, cmp_els);
-		if (n->l == NULL)
-			return NULL;
-	} else {
-		n->r = avl_insert(n->r, el, cmp_els);
-		if (n->r == NULL)
-			return NULL;
+	*link = new_node(el, NULL, NULL, pool);
+	if (*link == NULL)
+		return NULL;
+
+	fix_path(path, k);
+	return n;
+}
+
+/*
+ * AVL REMOVE: Remove a given element from the AVL
+ *    using a given comparison function. A node
+ *    with two children takes the element before
+ *    it and that element's node is removed.
+ */
+struct AVL* avl_remove(struct AVL* n, void* el, int (*cmp_els)(void*, void*),
+                                                          struct Pool* pool) {
+	struct AVL** path[AVL_MAX_HEIGHT];
+	struct AVL** link = &n;
+	struct AVL* aux;
+	int cmp, k = 0;
+
+	while (*link != NULL && (cmp = cmp_els(el, (*link)->el)) != 0) {
+		path[k++] = link;
+		link = cmp < 0 ? &(*link)->l : &(*link)->r;
 	}
+	if (*link == NULL)
+		return n;
+
+	if ((*link)->l != NULL && (*link)->r != NULL) {
+		aux = *link;
+		path[k++] = link;
+		for (link = &aux->l; (*link)->r != NULL; link = &(*link)->r)
+			path[k++] = link;
+		aux->el = (*link)->el;
+	}
+
+	aux = *link;
+	*link = aux->l != NULL ? aux->l : aux->r;
+	pool_free(pool, aux);
 
-	return balance(n);
+	fix_path(path, k);
+	return n;
 }
 
 /*
- * AVL REMOVE: Remve a given element from the AVL
- *    using a given comparison function.
+ * BUILD: Builds a balanced subtree with the n
+ *    given elements into the given link, the
+ *    middle one at the top. The depth is only
+ *    logarithmic in n. Returns 0 if it fails to
+ *    allocate memory.
  */
-struct AVL* avl_remove(struct AVL* n, void* el, int (*cmp_els)(void*, void*)) {
-	if (n == NULL)
+int build(struct AVL** link, void** els, int n, struct Pool* pool) {
+	int mid = n / 2;
+	struct AVL* node;
+
+	*link = NULL;
+	if (n == 0)
+		return 1;
+
+	node = new_node(els[mid], NULL, NULL, pool);
+	if (node == NULL)
+		return 0;
+	*link = node;
+	if (!build(&node->l, els, mid, pool) ||
+	    !build(&node->r, els + mid + 1, n - mid - 1, pool))
+		return 0;
+	compute_height(node);
+	return 1;
+}
+
+/*
+ * AVL BUILD: Builds an AVL with the n given
+ *    elements, which must already be in order,
+ *    in linear time. Returns NULL if there are
+ *    none or it fails to allocate memory.
+ */
+struct AVL* avl_build(void** els, int n, struct Pool* pool) {
+	struct AVL* root;
+
+	if (!build(&root, els, n, pool))
 		return NULL;
+	return root;
+}
+
+/*
+ * AVL SIZE: Returns the amount of elements in the
+ *    AVL.
+ */
+int avl_size(struct AVL* n) {
+	return size(n);
+}
 
-	if (cmp_els(el, n->el) < 0)
-		n->l = avl_remove(n->l, el, cmp_els);
-	else if (cmp_els(el, n->el) > 0)
-		n->r = avl_remove(n->r, el, cmp_els);
-	else {
-		if (n->l != NULL && n->r != NULL) {
-			n->el = max(n->l)->el;
-			n->l = avl_remove(n->l, n->el, cmp_els);
+/*
+ * AVL NTH: Returns the i-th smallest element,
+ *    counting from 0, or NULL if there are not
+ *    that many.
+ */
+void* avl_nth(struct AVL* n, int i) {
+	while (n != NULL) {
+		if (i < size(n->l)) {
+			n = n->l;
+		} else if (i == size(n->l)) {
+			return n->el;
+		} else {
+			i -= size(n->l) + 1;
+			n = n->r;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * AVL RANK: Returns the amount of elements
+ *    smaller than the given key.
+ */
+int avl_rank(struct AVL* n, void* k, int (*cmp_key_el)(void*, void*)) {
+	int rank = 0;
+
+	while (n != NULL) {
+		if (cmp_key_el(k, n->el) <= 0) {
+			n = n->l;
 		} else {
-			struct AVL* aux = n;
-			if (n->l != NULL)
-				n = n->l;
-			else
-				n = n->r;
-			free(aux);
+			rank += size(n->l) + 1;
+			n = n->r;
 		}
 	}
 
-	return balance(n);
+	return rank;
+}
+
+/*
+ * PUSH LEFT: Pushes a node and its left
+ *    descendants into the iterator's stack.
+ */
+void push_left(struct AVLIter* it, struct AVL* n) {
+	for (; n != NULL; n = n->l)
+		it->stack[it->k++] = n;
+}
+
+/*
+ * AVL SEEK: Places the iterator at the first
+ *    element not smaller than the given key, or
+ *    at the smallest element if there is no key.
+ */
+void avl_seek(struct AVLIter* it, struct AVL* n, void* k,
+                           int (*cmp_key_el)(void*, void*)) {
+	it->k = 0;
+
+	if (k == NULL) {
+		push_left(it, n);
+		return;
+	}
+
+	/* Only nodes not smaller than the key are left to walk */
+	while (n != NULL) {
+		if (cmp_key_el(k, n->el) <= 0) {
+			it->stack[it->k++] = n;
+			n = n->l;
+		} else {
+			n = n->r;
+		}
+	}
+}
+
+/*
+ * AVL NEXT: Returns the iterator's element and
+ *    moves it to the next one, or returns NULL
+ *    at the end.
+ */
+void* avl_next(struct AVLIter* it) {
+	struct AVL* n;
+
+	if (it->k == 0)
+		return NULL;
+
+	n = it->stack[--it->k];
+	push_left(it, n->r);
+	return n->el;
 }
 
 /*
@@ -230,20 +441,32 @@ struct AVL* avl_remove(struct AVL* n, void* el, int (*cmp_els)(void*, void*)) {
  *    the given function on every element.
  */
 void avl_traverse(struct AVL* n, void (*visit)(void*, void*), void* extra) {
-	if (n != NULL) {
-		avl_traverse(n->l, visit, extra);
-		visit(n->el, extra);
-		avl_traverse(n->r, visit, extra);
-	}
+	struct AVLIter it;
+	void* el;
+
+	avl_seek(&it, n, NULL, NULL);
+	while ((el = avl_next(&it)) != NULL)
+		visit(el, extra);
 }
 
 /*
- * AVL DESTROY: Free the AVL
+ * AVL DESTROY: Free the AVL. Left children are
+ *    rotated up until the node has none so no
+ *    stack is needed.
  */
-void avl_destroy(struct AVL* n) {
-	if (n != NULL) {
-		avl_destroy(n->l);
-		avl_destroy(n->r);
-		free(n);
+void avl_destroy(struct AVL* n, struct Pool* pool) {
+	struct AVL* x;
+
+	while (n != NULL) {
+		if (n->l != NULL) {
+			x = n->l;
+			n->l = x->r;
+			x->r = n;
+			n = x;
+		} else {
+			x = n->r;
+			pool_free(pool, n);
+			n = x;
+		}
 	}
 }
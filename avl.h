@@ -4,10 +4,36 @@
  * Desc:	This header exposes the AVL interface.
  */
 
+#define AVL_MAX_HEIGHT 96
+
 struct AVL;
+struct Pool;
+
+/************************************************
+ * AVL ITERATOR: Walks the elements in order.
+ * - stack: Nodes whose element and right subtree
+ *    are still to be walked, the next on top.
+ *
+ * - k: Amount of nodes in the stack.
+ *************************************************/
+struct AVLIter {
+	struct AVL* stack[AVL_MAX_HEIGHT];
+	int k;
+};
 
-struct AVL* avl_insert(struct AVL* n, void* el, int (*cmp_els)(void*, void*));
-struct AVL* avl_remove(struct AVL* n, void* el, int (*cmp_els)(void*, void*));
+struct Pool* avl_new_pool();
+struct AVL* avl_insert(struct AVL* n, void* el, int (*cmp_els)(void*, void*),
+                                                          struct Pool* pool);
+struct AVL* avl_remove(struct AVL* n, void* el, int (*cmp_els)(void*, void*),
+                                                          struct Pool* pool);
+struct AVL* avl_build(void** els, int n, struct Pool* pool);
+void* avl_min(struct AVL* n);
 void* avl_find(struct AVL* n, void* k, int (*cmp_key_el)(void*, void*));
+int avl_size(struct AVL* n);
+void* avl_nth(struct AVL* n, int i);
+int avl_rank(struct AVL* n, void* k, int (*cmp_key_el)(void*, void*));
+void avl_seek(struct AVLIter* it, struct AVL* n, void* k,
+                           int (*cmp_key_el)(void*, void*));
+void* avl_next(struct AVLIter* it);
 void avl_traverse(struct AVL* n, void (*visit)(void*, void*), void* extra);
-void avl_destroy(struct AVL* n);
+void avl_destroy(struct AVL* n, struct Pool* pool);
@@ -0,0 +1,164 @@
+/*
+ * File:	bulk_check.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Bulk check, writes files of random lines, with repeated
+ *    and nested paths, doubled and trailing slashes, blank lines and
+ *    lines with no value, and compares a bulk of each file with a set
+ *    for each of its lines by their saved snapshots, which must be
+ *    the same byte for byte. Both start empty, which builds the tree
+ *    in one go, and then from a few sets, which doesn't.
+ *    Build: gcc -O2 -pthread -I. -o bulk_check bench/bulk_check.c
+ *       fs.c avl.c cache.c hashtable.c input.c order.c output.c
+ *       pool.c snap.c sort.c
+ *    Usage: ./bulk_check [DIR] [ROUNDS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fs.h"
+#include "input.h"
+
+#define DEFAULT_DIR "/tmp"
+#define DEFAULT_ROUNDS 40
+#define MAX_LINES 5000
+#define LINE_SZ 256
+#define FILE_SZ 512
+
+char* names[] = { "a", "b", "ab", "a-b", "0", "Z", "cfg", "zzz", "n1", "n2" };
+char* values[] = { "v0", "v1", "v2", "same", "x y z", "tab\there" };
+char* seps[] = { " ", "   ", "\t ", "\t" };
+char* starts[] = { "", "", " ", "\t" };
+
+#define PICK(a) a[rand() % (sizeof(a) / sizeof(a[0]))]
+
+/*
+ * RANDOM LINE: Writes a random line of a bulk
+ *    file to the buffer.
+ */
+void random_line(char* line) {
+	int i, depth = 1 + rand() % 5;
+
+	if (rand() % 50 == 0) {
+		line[0] = '\0';
+		return;
+	}
+	strcpy(line, PICK(starts));
+	for (i = 0; i < depth; i++) {
+		if (i > 0 || rand() % 10 > 0)
+			strcat(line, rand() % 4 == 0 ? "//" : "/");
+		strcat(line, PICK(names));
+	}
+	if (rand() % 5 == 0)
+		strcat(line, "/");
+	if (rand() % 50 > 0) {
+		strcat(line, PICK(seps));
+		strcat(line, PICK(values));
+	}
+}
+
+/*
+ * SET LINE: Sets the path and value of a line
+ *    the way the set command reads them.
+ */
+int set_line(struct FS* fs, char* line) {
+	char copy[LINE_SZ];
+	char* args = copy;
+	char *path, *value;
+
+	strcpy(copy, line);
+	path = in_token(&args);
+	value = in_rest(&args);
+	return path == NULL || value == NULL ? OK : fs_set(fs, path, value);
+}
+
+/*
+ * SAME FILES: Returns whether two files have the
+ *    same bytes.
+ */
+int same_files(char* a, char* b) {
+	FILE* fa = fopen(a, "rb");
+	FILE* fb = fopen(b, "rb");
+	int ca = EOF, cb = EOF, same = fa != NULL && fb != NULL;
+
+	while (same && (ca = getc(fa)) == (cb = getc(fb)) && ca != EOF)
+		;
+	same = same && ca == cb;
+	if (fa != NULL)
+		fclose(fa);
+	if (fb != NULL)
+		fclose(fb);
+	return same;
+}
+
+/*
+ * CHECK: Writes n random lines to a file, loads
+ *    it with a bulk and with sets, on top of the
+ *    given amount of sets made to both first, and
+ *    compares the snapshots. Returns 0 if they
+ *    differ.
+ */
+int check(char* dir, char (*lines)[LINE_SZ], int n, int before) {
+	char file[FILE_SZ], snap_a[FILE_SZ], snap_b[FILE_SZ];
+	struct FS* a = fs_init();
+	struct FS* b = fs_init();
+	FILE* f;
+	int i, ok;
+
+	sprintf(file, "%s/bulk_check.txt", dir);
+	sprintf(snap_a, "%s/bulk_check_a.snap", dir);
+	sprintf(snap_b, "%s/bulk_check_b.snap", dir);
+	if (a == NULL || b == NULL || (f = fopen(file, "w")) == NULL) {
+		printf("can't write %s\n", file);
+		exit(1);
+	}
+
+	for (i = 0; i < before + n; i++)
+		random_line(lines[i]);
+	for (i = before; i < before + n; i++)
+		fprintf(f, "%s\n", lines[i]);
+	fclose(f);
+
+	for (i = 0, ok = 1; i < before; i++)
+		ok = ok && set_line(a, lines[i]) == OK &&
+		     set_line(b, lines[i]) == OK;
+	ok = ok && fs_bulk(a, file) == OK;
+	for (i = before; i < before + n; i++)
+		ok = ok && set_line(b, lines[i]) == OK;
+
+	ok = ok && fs_save(a, snap_a) == OK && fs_save(b, snap_b) == OK &&
+	     same_files(snap_a, snap_b);
+	if (!ok)
+		printf("%d lines after %d sets differ, see %s\n", n, before, file);
+
+	fs_destroy(a);
+	fs_destroy(b);
+	if (ok) {
+		remove(file);
+		remove(snap_a);
+		remove(snap_b);
+	}
+	return ok;
+}
+
+int main(int argc, char* argv[]) {
+	char* dir = argc > 1 ? argv[1] : DEFAULT_DIR;
+	int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+	char (*lines)[LINE_SZ] = malloc((MAX_LINES + 10) * LINE_SZ);
+	int i, ok = 1;
+
+	if (lines == NULL) {
+		printf("out of memory\n");
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < rounds && ok; i++) {
+		ok = check(dir, lines, rand() % (i < rounds / 2 ? 50 : MAX_LINES), 0);
+		ok = ok && check(dir, lines, rand() % MAX_LINES, 1 + rand() % 10);
+	}
+
+	free(lines);
+	printf(ok ? "ok\n" : "failed\n");
+	return !ok;
+}
@@ -0,0 +1,84 @@
+/*
+ * File:	finger_bench.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Finger benchmark, times N sets of new siblings split
+ *    between two directories of the same depth, for depths 1 to 32.
+ *    The siblings are set one directory after the other, so each set
+ *    shares its parent with the one before, and then alternating
+ *    between the directories, so no set shares more than the root.
+ *    Build: gcc -O2 -pthread -I. -o finger_bench bench/finger_bench.c
+ *       fs.c avl.c cache.c hashtable.c input.c order.c output.c pool.c
+ *       snap.c sort.c
+ *    Usage: ./finger_bench [N]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fs.h"
+
+#define DEFAULT_N 200000
+#define MAX_DEPTH 32
+#define PATH_SZ 512
+
+/*
+ * SECONDS: Returns the wall clock time.
+ */
+double seconds() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * RUN: Sets n siblings under two directories of
+ *    the given depth, alternating between them or
+ *    not, and returns the sets per second.
+ */
+double run(int n, int depth, int alternate) {
+	struct FS* fs = fs_init();
+	char dirs[2][PATH_SZ], path[PATH_SZ];
+	double start, s;
+	int i, k, d, half = n / 2;
+
+	if (fs == NULL) {
+		printf("out of memory\n");
+		exit(1);
+	}
+	for (d = 0; d < 2; d++) {
+		sprintf(dirs[d], "/tree-%d", d);
+		for (k = 1; k < depth; k++)
+			sprintf(dirs[d] + strlen(dirs[d]), "/level-%d", k);
+	}
+
+	start = seconds();
+	for (i = 0; i < 2 * half; i++) {
+		d = alternate ? i % 2 : i / half;
+		sprintf(path, "%s/node-%d", dirs[d], alternate ? i / 2 : i % half);
+		if (fs_set(fs, path, "v") != OK) {
+			printf("out of memory\n");
+			exit(1);
+		}
+	}
+	s = seconds() - start;
+
+	fs_destroy(fs);
+	return 2 * half / s;
+}
+
+int main(int argc, char* argv[]) {
+	int n = argc > 1 ? atoi(argv[1]) : DEFAULT_N;
+	int depth;
+
+	if (n < 2)
+		return 1;
+
+	for (depth = 1; depth <= MAX_DEPTH; depth *= 2)
+		printf("depth %-3d %12.0f sets/s siblings %12.0f sets/s alternating\n",
+		       depth, run(n, depth, 0), run(n, depth, 1));
+	return 0;
+}
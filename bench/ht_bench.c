@@ -0,0 +1,79 @@
+/*
+ * File:	ht_bench.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	HashTable microbenchmark, times inserting, finding and
+ *    removing N distinct keys.
+ *    Build: gcc -O2 -I. -o ht_bench bench/ht_bench.c hashtable.c
+ *    Usage: ./ht_bench [N]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hashtable.h"
+
+#define DEFAULT_N 1000000
+#define KEY_SZ 32
+
+/*
+ * KEY: The elements are the keys themselves.
+ */
+char* key(void* el) {
+	return el;
+}
+
+/*
+ * SAME: Returns 0 if both elements are the same.
+ */
+int same(void* el1, void* el2) {
+	return el1 != el2;
+}
+
+/*
+ * REPORT: Prints the time taken per operation.
+ */
+void report(char* op, clock_t start, int n) {
+	double s = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("%-8s %8.1f ns/op\n", op, s * 1e9 / n);
+}
+
+int main(int argc, char* argv[]) {
+	int i, n = argc > 1 ? atoi(argv[1]) : DEFAULT_N;
+	char* keys = malloc((size_t)n * KEY_SZ);
+	char miss[KEY_SZ];
+	struct HashTable* ht = NULL;
+	clock_t start;
+	long found = 0;
+
+	if (keys == NULL)
+		return 1;
+	for (i = 0; i < n; i++)
+		sprintf(keys + (size_t)i * KEY_SZ, "/srv/node-%d/version", i);
+
+	start = clock();
+	for (i = 0; i < n; i++)
+		ht = ht_insert(ht, keys + (size_t)i * KEY_SZ, key);
+	report("insert", start, n);
+
+	start = clock();
+	for (i = 0; i < n; i++)
+		found += ht_find(ht, keys + (size_t)i * KEY_SZ, key) != NULL;
+	report("hit", start, n);
+
+	start = clock();
+	for (i = 0; i < n; i++) {
+		sprintf(miss, "/srv/node-%d/missing", i);
+		found += ht_find(ht, miss, key) != NULL;
+	}
+	report("miss", start, n);
+
+	start = clock();
+	for (i = 0; i < n; i++)
+		ht = ht_remove(ht, keys + (size_t)i * KEY_SZ, key, same);
+	report("remove", start, n);
+
+	printf("found %ld of %d\n", found, n);
+	ht_destroy(ht);
+	free(keys);
+	return 0;
+}
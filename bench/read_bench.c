@@ -0,0 +1,208 @@
+/*
+ * File:	read_bench.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Read scaling benchmark, times finds of random paths
+ *    from 1 to 32 threads at once, with a thread making sets at the
+ *    same time unless WRITER is 0. The values found are printed to
+ *    /dev/null. With MIRROR set to 1 the paths are kept in a mirrored
+ *    store, whose readers don't wait for the writer, instead of one
+ *    filesystem under its reader-writer lock.
+ *    Build: gcc -O2 -pthread -I. -o read_bench bench/read_bench.c
+ *       mirror.c fs.c avl.c cache.c hashtable.c input.c order.c output.c
+ *       pool.c snap.c sort.c
+ *    Usage: ./read_bench [N] [READS] [WRITER] [MIRROR]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "fs.h"
+#include "mirror.h"
+#include "output.h"
+
+#define DEFAULT_N 100000
+#define DEFAULT_READS 1000000
+#define MAX_THREADS 32
+#define PATH_SZ 64
+#define VALUE_SZ 32
+
+/************************************************
+ * JOB: Work of one thread.
+ * - fs: Filesystem being read.
+ *
+ * - mirror: Mirrored store read instead, if not
+ *    NULL.
+ *
+ * - n: Amount of paths in it.
+ *
+ * - reads: Finds the thread makes, or the sets
+ *    made by the writer.
+ *
+ * - seed: State of the thread's random numbers.
+ *************************************************/
+struct Job {
+	struct FS* fs;
+	struct Mirror* mirror;
+	int n;
+	long reads;
+	unsigned long seed;
+};
+
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int done;
+
+/*
+ * SECONDS: Returns the wall clock time, threads
+ *    running at once add up in the CPU time.
+ */
+double seconds() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * RANDOM BELOW: Returns a random number below n,
+ *    rand can't be shared by the threads.
+ */
+int random_below(unsigned long* seed, int n) {
+	*seed = (*seed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+	return (int)((*seed >> 8) % n);
+}
+
+/*
+ * READER: Finds random paths.
+ */
+void* reader(void* arg) {
+	struct Job* job = arg;
+	char path[PATH_SZ];
+	long i;
+
+	for (i = 0; i < job->reads; i++) {
+		sprintf(path, "/srv/node-%d/cfg/version",
+		        random_below(&job->seed, job->n));
+		if (job->mirror != NULL)
+			mirror_find(job->mirror, path);
+		else
+			fs_find(job->fs, path);
+	}
+	out_flush();
+	return NULL;
+}
+
+/*
+ * WRITER: Sets random paths until the readers
+ *    are done, counting the sets in reads.
+ */
+void* writer(void* arg) {
+	struct Job* job = arg;
+	char path[PATH_SZ], value[VALUE_SZ];
+	int stop = 0;
+
+	for (job->reads = 0; !stop; job->reads++) {
+		sprintf(path, "/srv/node-%d/cfg/version",
+		        random_below(&job->seed, job->n));
+		sprintf(value, "w%ld", job->reads);
+		if (job->mirror != NULL)
+			mirror_set(job->mirror, path, value);
+		else
+			fs_set(job->fs, path, value);
+		if (job->reads % 1024 == 0) {
+			pthread_mutex_lock(&done_mutex);
+			stop = done;
+			pthread_mutex_unlock(&done_mutex);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * RUN: Makes reads finds split among the given
+ *    threads and prints the finds per second, and
+ *    the sets per second if there is a writer.
+ */
+void run(FILE* report, struct FS* fs, struct Mirror* mirror, int n,
+         long reads, int threads, int write) {
+	pthread_t ids[MAX_THREADS], wid;
+	struct Job jobs[MAX_THREADS], wjob;
+	double start, s;
+	int i;
+
+	done = 0;
+	wjob.fs = fs;
+	wjob.mirror = mirror;
+	wjob.n = n;
+	wjob.seed = 7;
+	if (write && pthread_create(&wid, NULL, writer, &wjob) != 0)
+		write = 0;
+
+	start = seconds();
+	for (i = 0; i < threads; i++) {
+		jobs[i].fs = fs;
+		jobs[i].mirror = mirror;
+		jobs[i].n = n;
+		jobs[i].reads = reads / threads;
+		jobs[i].seed = i + 1;
+		pthread_create(&ids[i], NULL, reader, &jobs[i]);
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(ids[i], NULL);
+	s = seconds() - start;
+
+	pthread_mutex_lock(&done_mutex);
+	done = 1;
+	pthread_mutex_unlock(&done_mutex);
+	if (write)
+		pthread_join(wid, NULL);
+
+	fprintf(report, "threads %-3d %12.0f finds/s", threads,
+	                      reads / threads * threads / s);
+	if (write)
+		fprintf(report, " %10.0f sets/s", wjob.reads / s);
+	fprintf(report, "\n");
+}
+
+int main(int argc, char* argv[]) {
+	int n = argc > 1 ? atoi(argv[1]) : DEFAULT_N;
+	long reads = argc > 2 ? atol(argv[2]) : DEFAULT_READS;
+	int write = argc > 3 ? atoi(argv[3]) : 1;
+	int mirrored = argc > 4 ? atoi(argv[4]) : 0;
+	struct FS* fs = mirrored ? NULL : fs_init();
+	struct Mirror* mirror = mirrored ? mirror_new() : NULL;
+	char path[PATH_SZ], value[VALUE_SZ];
+	FILE* report;
+	int i, null;
+
+	if ((fs == NULL && mirror == NULL) || n < 1)
+		return 1;
+	for (i = 0; i < n; i++) {
+		sprintf(path, "/srv/node-%d/cfg/version", i);
+		sprintf(value, "v%d", i);
+		if (mirror != NULL)
+			mirror_set(mirror, path, value);
+		else
+			fs_set(fs, path, value);
+	}
+
+	/* The finds print what they find, it is thrown away */
+	report = fdopen(dup(STDOUT_FILENO), "w");
+	null = open("/dev/null", O_WRONLY);
+	if (report == NULL || null < 0 || dup2(null, STDOUT_FILENO) < 0)
+		return 1;
+
+	for (i = 1; i <= MAX_THREADS; i *= 2)
+		run(report, fs, mirror, n, reads, i, write);
+
+	fclose(report);
+	if (mirror != NULL)
+		mirror_destroy(mirror);
+	else
+		fs_destroy(fs);
+	return 0;
+}
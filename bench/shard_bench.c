@@ -0,0 +1,97 @@
+/*
+ * File:	shard_bench.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Sharded store benchmark, times a bulk load of N sets in
+ *    batches of BATCH for 1 to 32 shards, each shard applying its
+ *    part of a batch in a thread of its own.
+ *    Build: gcc -O2 -pthread -I. -o shard_bench bench/shard_bench.c
+ *       shard.c fs.c avl.c cache.c hashtable.c input.c order.c output.c
+ *       pool.c snap.c sort.c
+ *    Usage: ./shard_bench [N] [BATCH]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fs.h"
+#include "shard.h"
+
+#define DEFAULT_N 1000000
+#define DEFAULT_BATCH 65536
+#define MAX_SHARDS 32
+#define PATH_SZ 64
+#define VALUE_SZ 32
+
+/*
+ * SECONDS: Returns the wall clock time, threads
+ *    running at once add up in the CPU time.
+ */
+double seconds() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * RUN: Loads n paths spread over a thousand
+ *    top-level directories into the given amount
+ *    of shards and prints the sets per second.
+ */
+void run(int n, int batch, int shards, char* paths, char* values,
+                                          struct ShardOp* ops) {
+	struct Shards* sh = shards_new(shards);
+	double start, applying = 0;
+	int i, j, len;
+
+	if (sh == NULL) {
+		printf("can't create %d shards\n", shards);
+		exit(1);
+	}
+
+	for (i = 0; i < n; i += batch) {
+		len = n - i < batch ? n - i : batch;
+
+		/* The paths are cut while applied, they're rebuilt every time */
+		for (j = 0; j < len; j++) {
+			ops[j].op = SHARD_SET;
+			ops[j].path = paths + (size_t)j * PATH_SZ;
+			ops[j].value = values + (size_t)j * VALUE_SZ;
+			sprintf(ops[j].path, "/tenant-%d/node-%d/version",
+			        (i + j) % 1000, i + j);
+			sprintf(ops[j].value, "v%d", i + j);
+		}
+
+		start = seconds();
+		if (shards_apply(sh, ops, len) != OK) {
+			printf("out of memory\n");
+			exit(1);
+		}
+		applying += seconds() - start;
+	}
+
+	printf("shards %-3d %12.0f sets/s\n", shards, n / applying);
+	shards_destroy(sh);
+}
+
+int main(int argc, char* argv[]) {
+	int n = argc > 1 ? atoi(argv[1]) : DEFAULT_N;
+	int batch = argc > 2 ? atoi(argv[2]) : DEFAULT_BATCH;
+	char* paths = malloc((size_t)batch * PATH_SZ);
+	char* values = malloc((size_t)batch * VALUE_SZ);
+	struct ShardOp* ops = malloc((size_t)batch * sizeof(struct ShardOp));
+	int shards;
+
+	if (batch < 1 || paths == NULL || values == NULL || ops == NULL)
+		return 1;
+
+	for (shards = 1; shards <= MAX_SHARDS; shards *= 2)
+		run(n, batch, shards, paths, values, ops);
+
+	free(paths);
+	free(values);
+	free(ops);
+	return 0;
+}
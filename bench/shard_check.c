@@ -0,0 +1,261 @@
+/*
+ * File:	shard_check.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Sharded store check, runs N random sets, deletes, finds
+ *    and searches, the root included, on a single filesystem and on
+ *    1, 2, 3 and 8 shards in batches of 1 and of up to BATCH changes,
+ *    and compares the status of every change and what every find and
+ *    search printed, along with their status.
+ *    Build: gcc -O2 -pthread -I. -o shard_check bench/shard_check.c
+ *       shard.c fs.c avl.c cache.c hashtable.c input.c order.c output.c
+ *       pool.c snap.c sort.c
+ *    Usage: ./shard_check [DIR] [N] [BATCH]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "fs.h"
+#include "shard.h"
+#include "output.h"
+
+#define DEFAULT_DIR "/tmp"
+#define DEFAULT_N 20000
+#define DEFAULT_BATCH 64
+#define PATH_SZ 64
+#define VALUE_SZ 16
+#define FILE_SZ 512
+
+#define STEP_SET 1
+#define STEP_DELETE 2
+#define STEP_FIND 3
+#define STEP_SEARCH 4
+
+/************************************************
+ * STEP: Command run on both stores.
+ * - op: One of the STEP_ codes.
+ *
+ * - path: Path set, deleted or found.
+ *
+ * - value: Value set or searched.
+ *************************************************/
+struct Step {
+	int op;
+	char path[PATH_SZ];
+	char value[VALUE_SZ];
+};
+
+char* names[] = { "a", "b", "c", "d", "e", "f", "ab", "x" };
+char* values[] = { "v1", "v2", "v3", "w" };
+int shard_counts[] = { 1, 2, 3, 8 };
+
+#define PICK(a) a[rand() % (sizeof(a) / sizeof(a[0]))]
+
+/*
+ * RANDOM STEP: Fills a random step, with paths
+ *    of up to three components and a few sets
+ *    and deletes of the root.
+ */
+void random_step(struct Step* s) {
+	int i, r = rand() % 100, depth = 1 + rand() % 3;
+
+	s->path[0] = '\0';
+	for (i = 0; i < depth; i++) {
+		strcat(s->path, "/");
+		strcat(s->path, PICK(names));
+	}
+	strcpy(s->value, PICK(values));
+
+	if (r < 50) {
+		s->op = STEP_SET;
+	} else if (r < 60) {
+		s->op = STEP_DELETE;
+	} else if (r < 62) {
+		s->op = STEP_DELETE;
+		strcpy(s->path, FS_ROOT);
+	} else if (r < 64) {
+		s->op = STEP_SET;
+		strcpy(s->path, FS_ROOT);
+	} else if (r < 80) {
+		s->op = STEP_FIND;
+	} else {
+		s->op = STEP_SEARCH;
+	}
+}
+
+/*
+ * PRINT STATUS: Prints the status of a step.
+ */
+void print_status(int status) {
+	out_chr('=');
+	out_num(status);
+	out_chr('\n');
+}
+
+/*
+ * REDIRECT: Sends the output to the given file.
+ */
+void redirect(char* file) {
+	int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	out_flush();
+	if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) {
+		fprintf(stderr, "can't write %s\n", file);
+		exit(1);
+	}
+	close(fd);
+}
+
+/*
+ * RUN SINGLE: Runs the steps on one filesystem.
+ */
+void run_single(struct Step* steps, int n) {
+	struct FS* fs = fs_init();
+	char path[PATH_SZ];
+	int i;
+
+	for (i = 0; i < n; i++) {
+		strcpy(path, steps[i].path);
+		if (steps[i].op == STEP_SET)
+			print_status(fs_set(fs, path, steps[i].value));
+		else if (steps[i].op == STEP_DELETE)
+			print_status(fs_remove(fs, path));
+		else if (steps[i].op == STEP_FIND)
+			print_status(fs_find(fs, path));
+		else
+			print_status(fs_search(fs, steps[i].value));
+	}
+	fs_destroy(fs);
+}
+
+/*
+ * APPLY BATCH: Applies a batch to the shards and
+ *    prints the status of each change. Returns 0,
+ *    the size of the next batch.
+ */
+int apply_batch(struct Shards* sh, struct ShardOp* ops, int len) {
+	int j;
+
+	if (len > 0 && shards_apply(sh, ops, len) != OK) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (j = 0; j < len; j++)
+		print_status(ops[j].status);
+	return 0;
+}
+
+/*
+ * RUN SHARDS: Runs the steps on the given amount
+ *    of shards, the changes between two queries
+ *    applied in batches of up to the given size.
+ */
+void run_shards(struct Step* steps, int n, int shards, int batch,
+                struct ShardOp* ops, char (*paths)[PATH_SZ]) {
+	struct Shards* sh = shards_new(shards);
+	char path[PATH_SZ];
+	int i, len = 0;
+
+	if (sh == NULL) {
+		fprintf(stderr, "can't create %d shards\n", shards);
+		exit(1);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (steps[i].op == STEP_SET || steps[i].op == STEP_DELETE) {
+			strcpy(paths[len], steps[i].path);
+			ops[len].op = steps[i].op == STEP_SET ? SHARD_SET : SHARD_DELETE;
+			ops[len].path = paths[len];
+			ops[len].value = steps[i].value;
+			if (++len == batch)
+				len = apply_batch(sh, ops, len);
+			continue;
+		}
+
+		len = apply_batch(sh, ops, len);
+		strcpy(path, steps[i].path);
+		if (steps[i].op == STEP_FIND)
+			print_status(shards_find(sh, path));
+		else
+			print_status(shards_search(sh, steps[i].value));
+	}
+	apply_batch(sh, ops, len);
+	shards_destroy(sh);
+}
+
+/*
+ * SAME FILES: Returns whether two files have the
+ *    same bytes.
+ */
+int same_files(char* a, char* b) {
+	FILE* fa = fopen(a, "rb");
+	FILE* fb = fopen(b, "rb");
+	int ca = EOF, cb = EOF, same = fa != NULL && fb != NULL;
+
+	while (same && (ca = getc(fa)) == (cb = getc(fb)) && ca != EOF)
+		;
+	same = same && ca == cb;
+	if (fa != NULL)
+		fclose(fa);
+	if (fb != NULL)
+		fclose(fb);
+	return same;
+}
+
+int main(int argc, char* argv[]) {
+	char* dir = argc > 1 ? argv[1] : DEFAULT_DIR;
+	int n = argc > 2 ? atoi(argv[2]) : DEFAULT_N;
+	int batch = argc > 3 ? atoi(argv[3]) : DEFAULT_BATCH;
+	struct Step* steps = malloc((size_t)(n > 0 ? n : 1) * sizeof(struct Step));
+	struct ShardOp* ops = malloc((size_t)batch * sizeof(struct ShardOp));
+	char (*paths)[PATH_SZ] = malloc((size_t)batch * PATH_SZ);
+	char expected[FILE_SZ], got[FILE_SZ];
+	int sizes[2];
+	int i, k, b, stdout_fd = dup(STDOUT_FILENO), ok = 1;
+
+	if (n < 0 || batch < 1 || stdout_fd < 0)
+		return 1;
+	if (steps == NULL || ops == NULL || paths == NULL) {
+		printf("out of memory\n");
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < n; i++)
+		random_step(&steps[i]);
+
+	sizes[0] = 1;
+	sizes[1] = batch;
+	sprintf(expected, "%s/shard_check_fs.txt", dir);
+	sprintf(got, "%s/shard_check_shards.txt", dir);
+	redirect(expected);
+	run_single(steps, n);
+
+	for (k = 0; k < (int)(sizeof(shard_counts) / sizeof(int)) && ok; k++) {
+		for (b = 0; b < 2 && ok; b++) {
+			redirect(got);
+			run_shards(steps, n, shard_counts[k], sizes[b], ops, paths);
+			out_flush();
+			ok = same_files(expected, got);
+			if (!ok)
+				fprintf(stderr, "%d shards in batches of %d differ, see %s\n",
+				        shard_counts[k], sizes[b], got);
+		}
+	}
+
+	out_flush();
+	dup2(stdout_fd, STDOUT_FILENO);
+	if (ok) {
+		remove(expected);
+		remove(got);
+	}
+	printf(ok ? "ok\n" : "failed\n");
+	free(steps);
+	free(ops);
+	free(paths);
+	return !ok;
+}
@@ -0,0 +1,75 @@
+/*
+ * File:	sort_check.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Parallel sort check, sorts arrays of every length up to N
+ *    with psort split in 2, 3, 7 and 8 runs, so the merges leave a
+ *    run alone in some rounds, and compares them with qsort. Keys
+ *    repeat so equal elements are merged too.
+ *    Build: gcc -O2 -pthread -I. -o sort_check bench/sort_check.c sort.c
+ *    Usage: ./sort_check [N]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sort.h"
+
+#define DEFAULT_N 300
+#define LONG_N 100003
+#define KEYS 50
+
+int run_counts[] = { 1, 2, 3, 7, 8 };
+
+/*
+ * COMPARE INTS: Orders integers.
+ */
+int cmp_ints(const void* a, const void* b) {
+	int x = *(const int*)a, y = *(const int*)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * CHECK: Sorts n random integers with psort in
+ *    the given amount of runs and with qsort.
+ *    Returns 0 if they differ.
+ */
+int check(int* a, int* b, size_t n, int runs) {
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		a[i] = b[i] = rand() % KEYS;
+	psort_runs(a, n, sizeof(int), cmp_ints, runs);
+	qsort(b, n, sizeof(int), cmp_ints);
+
+	if (memcmp(a, b, n * sizeof(int)) != 0) {
+		printf("%lu elements in %d runs differ\n", (unsigned long)n, runs);
+		return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char* argv[]) {
+	int n = argc > 1 ? atoi(argv[1]) : DEFAULT_N;
+	int* a = malloc(LONG_N * sizeof(int));
+	int* b = malloc(LONG_N * sizeof(int));
+	int i, k, ok = 1;
+
+	if (n < 0 || n > LONG_N)
+		return 1;
+	if (a == NULL || b == NULL) {
+		printf("out of memory\n");
+		return 1;
+	}
+
+	srand(1);
+	for (k = 0; k < (int)(sizeof(run_counts) / sizeof(int)); k++) {
+		for (i = 0; i <= n; i++)
+			ok &= check(a, b, i, run_counts[k]);
+		ok &= check(a, b, LONG_N, run_counts[k]);
+	}
+
+	free(a);
+	free(b);
+	printf(ok ? "ok\n" : "failed\n");
+	return !ok;
+}
@@ -0,0 +1,90 @@
+/*
+ * File:	wal_bench.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Write-ahead log benchmark, times N sets without the log
+ *    and with it for a few group sizes.
+ *    Build: gcc -O2 -I. -o wal_bench bench/wal_bench.c fs.c avl.c
+ *       cache.c hashtable.c input.c order.c output.c pool.c snap.c
+ *       sort.c wal.c
+ *    Usage: ./wal_bench [N] [LOG]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "fs.h"
+#include "wal.h"
+
+#define DEFAULT_N 100000
+#define DEFAULT_LOG "wal_bench.log"
+#define PATH_SZ 64
+#define VALUE_SZ 32
+#define NO_INTERVAL 1000000
+
+/*
+ * SECONDS: Returns the wall clock time, syncing
+ *    to disk doesn't show in the CPU time.
+ */
+double seconds() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * RUN: Sets n paths on a new filesystem, logging
+ *    them in groups of the given size, or not at
+ *    all if group is 0, and prints the sets per
+ *    second.
+ */
+void run(int n, char* log, int group) {
+	struct FS* fs = fs_init();
+	struct Wal* wal = NULL;
+	char path[PATH_SZ], value[VALUE_SZ];
+	double start;
+	int i;
+
+	if (group > 0) {
+		unlink(log);
+		wal = wal_open(log, NULL, group, NO_INTERVAL);
+		if (wal == NULL) {
+			printf("can't open %s\n", log);
+			exit(1);
+		}
+	}
+
+	start = seconds();
+	for (i = 0; i < n; i++) {
+		sprintf(path, "/srv/node-%d/cfg/version", i);
+		sprintf(value, "v%d", i);
+		if (wal != NULL)
+			wal_append(wal, WAL_SET, path, value);
+		fs_set(fs, path, value);
+	}
+	if (wal != NULL)
+		wal_close(wal);
+
+	if (group > 0)
+		printf("group %-6d %10.0f sets/s\n", group, n / (seconds() - start));
+	else
+		printf("no log       %10.0f sets/s\n", n / (seconds() - start));
+	fs_destroy(fs);
+}
+
+int main(int argc, char* argv[]) {
+	int n = argc > 1 ? atoi(argv[1]) : DEFAULT_N;
+	char* log = argc > 2 ? argv[2] : DEFAULT_LOG;
+
+	run(n, log, 0);
+	run(n / 100, log, 1);
+	run(n, log, 16);
+	run(n, log, 128);
+	run(n, log, 1024);
+
+	unlink(log);
+	return 0;
+}
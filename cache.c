@@ -0,0 +1,204 @@
+/*
+ * File:	cache.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Path cache implementation, a bounded table of strings
+ *    whose entries are evicted by the clock algorithm. Every entry
+ *    keeps the generation it was cached in, and is only valid while
+ *    the generation asked for is the same.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "hashtable.h"
+#include "cache.h"
+
+/************************************************
+ * ENTRY: Cached string.
+ * - key: Copy of the string.
+ *
+ * - cap: Room for the key, kept when the entry
+ *    is reused for shorter ones.
+ *
+ * - hash: Hash of the key.
+ *
+ * - val: Cached value.
+ *
+ * - gen: Generation the value was cached in.
+ *
+ * - ref: Set when the entry is used, cleared as
+ *    the clock hand goes past it.
+ *************************************************/
+struct Entry {
+	char* key;
+	size_t cap;
+	unsigned int hash;
+	void* val;
+	unsigned long gen;
+	int ref;
+};
+
+/************************************************
+ * CACHE:
+ * - entries: Every entry, in the order the clock
+ *    hand goes through them.
+ *
+ * - n: Amount of entries.
+ *
+ * - used: Entries holding a key, the first ones.
+ *
+ * - hand: Next entry the clock hand looks at.
+ *
+ * - table: The entries holding a key, by key.
+ *
+ * - stats: Statistics of the lookups.
+ *************************************************/
+struct Cache {
+	struct Entry* entries;
+	int n, used, hand;
+	struct HashTable* table;
+	struct CacheStats stats;
+};
+
+/*
+ * ENTRY KEY: Given an entry return its key.
+ */
+char* entry_key(void* e) {
+	return ((struct Entry*)e)->key;
+}
+
+/*
+ * SAME ENTRY: Returns 0 if both are the same.
+ */
+int same_entry(void* e1, void* e2) {
+	return e1 != e2;
+}
+
+/*
+ * CACHE NEW: Creates an empty cache of n entries.
+ */
+struct Cache* cache_new(int n) {
+	struct Cache* c = malloc(sizeof(struct Cache));
+
+	if (c == NULL)
+		return NULL;
+	c->entries = malloc(n * sizeof(struct Entry));
+	c->table = ht_new(n);
+	if (c->entries == NULL || c->table == NULL) {
+		free(c->entries);
+		if (c->table != NULL)
+			ht_destroy(c->table);
+		free(c);
+		return NULL;
+	}
+	c->n = n;
+	c->used = c->hand = 0;
+	memset(&c->stats, 0, sizeof(c->stats));
+	return c;
+}
+
+/*
+ * CACHE GET: Returns the value cached for a key
+ *    in the given generation, or NULL if there
+ *    is none.
+ */
+void* cache_get(struct Cache* c, char* key, unsigned int hash,
+                                           unsigned long gen) {
+	struct Entry* e = ht_find_hashed(c->table, key, hash, entry_key);
+
+	if (e == NULL || e->gen != gen) {
+		c->stats.misses++;
+		return NULL;
+	}
+	e->ref = 1;
+	c->stats.hits++;
+	return e->val;
+}
+
+/*
+ * VICTIM: Returns the entry to reuse for a new
+ *    key, an unused one while there are any and
+ *    then the first one the clock hand finds that
+ *    wasn't used since it last went past it.
+ */
+struct Entry* victim(struct Cache* c) {
+	struct Entry* e;
+
+	if (c->used < c->n) {
+		e = &c->entries[c->used++];
+		e->key = NULL;
+		e->cap = 0;
+		e->ref = 0;
+		return e;
+	}
+
+	for (;; c->hand = (c->hand + 1) % c->n) {
+		e = &c->entries[c->hand];
+		if (!e->ref)
+			break;
+		e->ref = 0;
+	}
+	c->hand = (c->hand + 1) % c->n;
+	return e;
+}
+
+/*
+ * CACHE PUT: Caches the value of a key, which has
+ *    the given length and hash, for a generation.
+ *    Returns 0 if it fails to allocate memory,
+ *    the cache is then left as it was.
+ */
+int cache_put(struct Cache* c, char* key, size_t len, unsigned int hash,
+                                          void* val, unsigned long gen) {
+	struct Entry* e = ht_find_hashed(c->table, key, hash, entry_key);
+	struct HashTable* t;
+	char* copy = NULL;
+
+	if (e == NULL) {
+		e = victim(c);
+		if (len >= e->cap && (copy = malloc(len + 1)) == NULL)
+			return 0;
+
+		if (e->key != NULL) {
+			c->table = ht_remove_hashed(c->table, e, e->hash, same_entry);
+			c->stats.evictions++;
+		}
+		if (copy != NULL) {
+			free(e->key);
+			e->key = copy;
+			e->cap = len + 1;
+		}
+		memcpy(e->key, key, len + 1);
+		e->hash = hash;
+
+		/* The entry is placed even if the table fails to grow */
+		t = ht_insert_hashed(c->table, e, hash);
+		if (t != NULL)
+			c->table = t;
+	}
+
+	e->val = val;
+	e->gen = gen;
+	e->ref = 1;
+	return 1;
+}
+
+/*
+ * CACHE STATISTICS: Returns the statistics of
+ *    the cache, which the user can add to.
+ */
+struct CacheStats* cache_stats(struct Cache* c) {
+	return &c->stats;
+}
+
+/*
+ * CACHE DESTROY: Frees the cache.
+ */
+void cache_destroy(struct Cache* c) {
+	int i;
+
+	for (i = 0; i < c->used; i++)
+		free(c->entries[i].key);
+	free(c->entries);
+	ht_destroy(c->table);
+	free(c);
+}
@@ -0,0 +1,35 @@
+/*
+ * File:	cache.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the path cache interface.
+ */
+
+#include <stddef.h>
+
+/************************************************
+ * CACHE STATISTICS:
+ * - hits, misses: Lookups that found a valid
+ *    entry, and those that didn't.
+ *
+ * - evictions: Entries taken by the clock hand.
+ *
+ * - hit_ns, miss_ns: Time taken by the sampled
+ *    hits and misses, in nanoseconds.
+ *
+ * - hit_samples, miss_samples: Amount of them.
+ *************************************************/
+struct CacheStats {
+	unsigned long hits, misses, evictions;
+	unsigned long hit_ns, miss_ns;
+	unsigned long hit_samples, miss_samples;
+};
+
+struct Cache;
+
+struct Cache* cache_new(int n);
+void* cache_get(struct Cache* c, char* key, unsigned int hash,
+                                           unsigned long gen);
+int cache_put(struct Cache* c, char* key, size_t len, unsigned int hash,
+                                          void* val, unsigned long gen);
+struct CacheStats* cache_stats(struct Cache* c);
+void cache_destroy(struct Cache* c);
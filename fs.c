@@ -4,83 +4,341 @@
  * Desc:	Filesystem implementation.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <string.h>
 #include <stdlib.h>
-#include <stdio.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include "pool.h"
 #include "avl.h"
+#include "order.h"
 #include "hashtable.h"
+#include "output.h"
+#include "snap.h"
+#include "sort.h"
+#include "input.h"
+#include "cache.h"
 #include "fs.h"
 
+#define INDEX_THRESHOLD 64
+#define BULK_FRACTION 2
+#define REBUILD_RATIO 8
+#define ALIVE INT_MAX
+#define CACHE_SZ 8192
+#define CACHE_SAMPLE 64
+
 /************************************************
  * DIRECTORY:
  * - id: Each directory has an unique ID number
  *    assigned by order of creation.
  *
- * - depth: Number of edges from itself to the
- *    filesystem root.
- *
- * - path: Relative path to it's parent.
+ * - path: Relative path to it's parent, interned
+ *    so equal paths share the same name.
  *
  * - value: Value assigned to the directory, or
  *    NULL if no value has been set
  *
  * - p: The parent node.
  *
- * - subdirs_by_id: AVL BST containing the node's
- *    subdirectories ordered by the subdirs ids.
+ * - open, close: Tags placed before and after
+ *    the tags of every subdirectory, in a list
+ *    of the whole filesystem. The open tags are
+ *    in the order directories are printed in.
  *
- * - subdirs_by_path: Same as above but ordered by
- *    relative path.
+ * - first, last: Oldest and newest subdirectory,
+ *    subdirectories are linked by creation order,
+ *    which is also the order of their ids.
+ *
+ * - prev, next: Siblings created right before and
+ *    after the directory.
+ *
+ * - subdirs_by_path: AVL BST containing the
+ *    node's subdirectories ordered by relative
+ *    path.
+ *
+ * - n_subdirs: Number of subdirectories.
+ *
+ * - size: Number of directories in its subtree,
+ *    itself included.
+ *
+ * - index: Hash index of the subdirectories, only
+ *    kept for wide directories, NULL otherwise.
+ *
+ * - born, died: Epochs the directory was created
+ *    and removed in, died is ALIVE until then.
+ *    Removed directories seen by a snapshot stay
+ *    in their siblings' list, out of everything
+ *    else, until the snapshot is released.
+ *
+ * - since: Epoch the value was assigned in.
+ *
+ * - history: Values the directory held before,
+ *    newest first, kept only while a snapshot
+ *    sees them.
  *************************************************/
 struct Directory {
 	int id;
-	int depth;
-	char* path;
-	char* value;
+	struct Name* path;
+	struct Value* value;
 	struct Directory* p;
-	struct AVL* subdirs_by_id;
+	struct Tag open, close;
+	struct Directory *first, *last;
+	struct Directory *prev, *next;
 	struct AVL* subdirs_by_path;
+	int n_subdirs;
+	int size;
+	struct Index* index;
+	int born, died, since;
+	struct Version* history;
+};
+
+/************************************************
+ * NAME: Interned relative path, every distinct
+ *    path is stored once.
+ * - len: Length of the string.
+ *
+ * - hash: Hash of the string.
+ *
+ * - pfx: First bytes of the string packed in
+ *    big-endian order, so most names can be
+ *    ordered without comparing the strings.
+ *
+ * - refs: Directories using it, the last one to
+ *    be freed frees the name.
+ *
+ * - str: The string.
+ *************************************************/
+struct Name {
+	size_t len;
+	unsigned int hash;
+	unsigned long pfx;
+	int refs;
+	char str[1];
+};
+
+/************************************************
+ * VALUE: Interned value, every distinct value
+ *    is stored once.
+ * - holders: AVL BST of the directories holding
+ *    it, ordered by the order they're printed in
+ *    so the first one is the search result.
+ *
+ * - len: Length of the string.
+ *
+ * - hash: Hash of the string.
+ *
+ * - refs: Versions and removed directories that
+ *    still hold it for a snapshot. A value no
+ *    directory holds leaves the lookup table but
+ *    is only freed once it has none.
+ *
+ * - str: The string.
+ *************************************************/
+struct Value {
+	struct AVL* holders;
+	unsigned int len;
+	unsigned int hash;
+	int refs;
+	char str[1];
+};
+
+/************************************************
+ * VERSION: Value a directory held before.
+ * - value: The value.
+ *
+ * - since, until: Epochs it was held from and up
+ *    to, not included.
+ *
+ * - next: Older version of the same directory.
+ *************************************************/
+struct Version {
+	struct Value* value;
+	int since, until;
+	struct Version* next;
+};
+
+/************************************************
+ * INDEX:
+ * - ht: Hashtable of the subdirectories keyed by
+ *    relative path.
+ *
+ * - prev, next: Neighbours in the list of every
+ *    index, kept so they can be freed when the
+ *    directories are released at once.
+ *************************************************/
+struct Index {
+	struct HashTable* ht;
+	struct Index *prev, *next;
+};
+
+/************************************************
+ * PATH BUFFER:
+ * - s: Full path being assembled, not NUL
+ *    terminated.
+ *
+ * - len: Length of the path.
+ *
+ * - cap: Capacity of the buffer.
+ *
+ * - oom: Set when the buffer failed to grow.
+ *************************************************/
+struct PathBuf {
+	char* s;
+	size_t len, cap;
+	int oom;
+};
+
+/************************************************
+ * FINGER: Last path a thread followed, so the
+ *    next one can resume from the prefix they
+ *    share.
+ * - gen: Generation of the filesystem it was
+ *    followed in.
+ *
+ * - dirs: Directories along it, the root first.
+ *
+ * - len: Amount of them, 0 if there is no path.
+ *
+ * - cap: Capacity of the array.
+ *************************************************/
+struct Finger {
+	unsigned long gen;
+	struct Directory** dirs;
+	int len, cap;
+};
+
+/************************************************
+ * VALUE LIST:
+ * - vals: Values no directory holds anymore,
+ *    collected while a subtree is removed.
+ *
+ * - len: Amount of values in the list.
+ *
+ * - cap: Capacity of the list.
+ *************************************************/
+struct ValueList {
+	struct Value** vals;
+	size_t len, cap;
+};
+
+/************************************************
+ * DIRECTORY LIST:
+ * - dirs: The directories.
+ *
+ * - len: Amount of directories in the list.
+ *
+ * - cap: Capacity of the list.
+ *************************************************/
+struct DirList {
+	struct Directory** dirs;
+	size_t len, cap;
+};
+
+/************************************************
+ * SNAPSHOT: Frozen view of the filesystem, every
+ *    change made after it has a later epoch.
+ * - epoch: Epoch of the view, also its handle.
+ *
+ * - root: Root directory at the time.
+ *
+ * - next: Snapshot taken before it.
+ *************************************************/
+struct Snapshot {
+	int epoch;
+	struct Directory* root;
+	struct Snapshot* next;
 };
 
 /************************************************
  * FS:
  * - root: Root directory of the filesystem.
  *
- * - lookup: Lookup table for fast value searching.
+ * - lookup: Lookup table for fast value searching,
+ *    holds every value in use.
+ *
+ * - next_id: ID of the next directory created.
+ *
+ * - lock: Held shared by the functions that only
+ *    read and exclusively by those that make
+ *    changes, so readers run at the same time.
+ *
+ * - gone: List reused to collect the values a
+ *    removal leaves unused.
+ *
+ * - dirs: Pool the directories are taken from.
+ *
+ * - nodes: Pool the AVL nodes are taken from.
+ *
+ * - strs: Arena holding every path and value.
+ *
+ * - indexes: List of the hash indexes of every
+ *    wide directory.
+ *
+ * - names: Table of interned names, each kept
+ *    while a directory uses it.
+ *
+ * - epoch: Epoch of the changes being made.
+ *
+ * - snaps: Snapshots not yet released, newest
+ *    first.
+ *
+ * - newest: Epoch of the newest of them, -1 if
+ *    there are none.
+ *
+ * - graves: Removed directories kept for the
+ *    snapshots, by the order they were removed.
+ *
+ * - hist: Directories with older versions.
+ *
+ * - versions: Pool the versions are taken from.
+ *
+ * - gen: Generation of the directories, changed
+ *    by every removal and every load so cached
+ *    paths found before are no longer trusted.
+ *    Generations are never repeated, even by
+ *    other filesystems.
  *************************************************/
 struct FS {
 	struct Directory* root;
 	struct HashTable* lookup;
+	int next_id;
+	pthread_rwlock_t lock;
+	struct ValueList gone;
+	struct Pool* dirs;
+	struct Pool* nodes;
+	struct Arena* strs;
+	struct Index* indexes;
+	struct HashTable* names;
+	int epoch, newest;
+	struct Snapshot* snaps;
+	struct DirList graves, hist;
+	struct Pool* versions;
+	unsigned long gen;
 };
 
-/*
- * STRDUP: Returns the duplicate of a string,
- *    returns NULL if it fails to allocate memory
-*/
-char* strdup(char* str) {
-	char* new_str = malloc(strlen(str) + 1);
-	if (new_str == NULL)
-		return NULL;
-	return strcpy(new_str, str);
-}
-
 /*
  * NEW DIRECTORY: Creates a new directory.
  */
-struct Directory* new_directory(char* rel_path, int depth) {
-	static int id = 0;
-	struct Directory* dir = malloc(sizeof(struct Directory));
+struct Directory* new_directory(struct FS* fs, struct Name* rel_path) {
+	struct Directory* dir = pool_alloc(fs->dirs);
 	if (dir == NULL)
 		return NULL;
-	dir->id = id++;
-	dir->depth = depth;
-	dir->path = strdup(rel_path);
-	if (dir->path == NULL)
-		return NULL;
+	dir->id = fs->next_id++;
+	dir->path = rel_path;
+	rel_path->refs++;
 	dir->value = NULL;
 	dir->p = NULL;
-	dir->subdirs_by_id = NULL;
+	dir->first = dir->last = NULL;
+	dir->prev = dir->next = NULL;
 	dir->subdirs_by_path = NULL;
+	dir->n_subdirs = 0;
+	dir->size = 1;
+	dir->index = NULL;
+	dir->born = dir->since = fs->epoch;
+	dir->died = ALIVE;
+	dir->history = NULL;
 	return dir;
 }
 
@@ -91,14 +349,36 @@ struct Directory* new_directory(char* rel_path, int depth) {
  */
 
 /*
- * SEARCH PATH: Compare a given path to the path
+ * COMPARE NAMES: Orders two names the same way
+ *    strcmp orders their strings.
+ */
+int cmp_names(struct Name* name1, struct Name* name2) {
+	if (name1 == name2)
+		return 0;
+	if (name1->pfx != name2->pfx)
+		return name1->pfx < name2->pfx ? -1 : 1;
+
+	/* Distinct names with the same prefix fill it */
+	return strcmp(name1->str + sizeof(unsigned long),
+	              name2->str + sizeof(unsigned long));
+}
+
+/*
+ * SEARCH PATH: Compare a given name to the path
  *    of a given directory, used for searching in
  *    AVLs.
  */
-int search_path(void* path, void* dir) {
-	char* path1 = (char*)path;
-	char* path2 = ((struct Directory*)dir)->path;
-	return strcmp(path1, path2);
+int search_path(void* name, void* dir) {
+	return cmp_names(name, ((struct Directory*)dir)->path);
+}
+
+/*
+ * SEARCH STRING: Compares a string, which might
+ *    not be interned, with a directory's relative
+ *    path the same way names are ordered.
+ */
+int search_str(void* str, void* dir) {
+	return strcmp(str, ((struct Directory*)dir)->path->str);
 }
 
 /*
@@ -106,9 +386,8 @@ int search_path(void* path, void* dir) {
  *    the paths.
  */
 int cmp_paths(void* dir1, void* dir2) {
-	char* path1 = ((struct Directory*)dir1)->path;
-	char* path2 = ((struct Directory*)dir2)->path;
-	return strcmp(path1, path2);
+	return cmp_names(((struct Directory*)dir1)->path,
+	                 ((struct Directory*)dir2)->path);
 }
 
 /*
@@ -122,16 +401,47 @@ int cmp_ids(void* dir1, void* dir2) {
 }
 
 /*
- * DIRECTORY VALUE: Given a directory return the
- *    value string.
+ * DIRECTORY PATH: Given a directory return the
+ *    relative path.
+ */
+char* dir_path(void* dir) {
+	return ((struct Directory*)dir)->path->str;
+}
+
+/*
+ * NAME STRING: Given a name return the string.
+ */
+char* name_str(void* name) {
+	return ((struct Name*)name)->str;
+}
+
+/*
+ * VALUE STRING: Given a value return the string.
+ */
+char* value_str(void* val) {
+	return ((struct Value*)val)->str;
+}
+
+/*
+ * SAME NAME: Given two names return 0 if
+ *    they're the same.
+ */
+int same_name(void* name1, void* name2) {
+	return name1 != name2;
+}
+
+/*
+ * COMPARE VALUES: Given two values return 0 if
+ *    they're the same.
  */
-char* dir_value(void* dir) {
-	return ((struct Directory*)dir)->value;
+int cmp_values(void* val1, void* val2) {
+	return val1 != val2;
 }
 
 /*
  * MORE RECENT: Returns true if the directory in
- *    the first argument is the more "recent".
+ *    the first argument is the more "recent",
+ *    the one printed first.
  */
 int more_recent(void* dir1, void* dir2) {
 	struct Directory* new_dir = dir1;
@@ -141,268 +451,3293 @@ int more_recent(void* dir1, void* dir2) {
 	if (old_dir == NULL)
 		return 1;
 
-	/* Backtrack the deepest until both have same depth */
-	while (new_dir->depth > old_dir->depth)
-		new_dir = new_dir->p;
-	while (old_dir->depth > new_dir->depth)
-		old_dir = old_dir->p;
-
-	/* Backtrack both until they have the same parent */
-	while (new_dir->p != old_dir->p) {
-		new_dir = new_dir->p;
-		old_dir = old_dir->p;
-	}
+	return new_dir->open.label < old_dir->open.label;
+}
 
-	/* Compare order of creation, return true if new_dir is more recent */
-	return new_dir->id < old_dir->id;
+/*
+ * COMPARE ORDER: Given two directories compare
+ *    the order they're printed in.
+ */
+int cmp_order(void* dir1, void* dir2) {
+	if (dir1 == dir2)
+		return 0;
+	return more_recent(dir1, dir2) ? -1 : 1;
 }
 
 /*
- * PRINT DIRECTORY RELATIVE PATH
+ * PATH BUFFER RESERVE: Makes sure the buffer can
+ *    hold a path with the given length.
  */
-void print_dir_relative_path(void* d, void* extra) {
-	struct Directory* dir = d;
+int pb_reserve(struct PathBuf* pb, size_t n) {
+	char* s;
+	size_t cap = pb->cap > 0 ? pb->cap : 256;
 
-	/* No extra arguments are needed */
-	(void)extra;
+	if (n <= pb->cap)
+		return 1;
 
-	printf("%s\n", dir->path);
+	while (cap < n)
+		cap *= 2;
+	s = realloc(pb->s, cap);
+	if (s == NULL) {
+		pb->oom = 1;
+		return 0;
+	}
+	pb->s = s;
+	pb->cap = cap;
+	return 1;
 }
 
 /*
- * PRINT DIRECTORY FULL PATH
+ * PATH BUFFER PUSH: Appends a directory to the
+ *    path in the buffer.
  */
-void print_dir_full_path(struct Directory* dir) {
-	if (dir->p != NULL && strcmp(dir->p->path, FS_ROOT) != 0)
-		print_dir_full_path(dir->p);
+int pb_push(struct PathBuf* pb, struct Directory* dir) {
+	size_t n = dir->path->len;
 
-	printf("/%s", dir->path);
+	if (!pb_reserve(pb, pb->len + n + 1))
+		return 0;
+	pb->s[pb->len++] = '/';
+	memcpy(pb->s + pb->len, dir->path->str, n);
+	pb->len += n;
+	return 1;
 }
 
 /*
- * PRINT ALL: Print the full path of every
- *    directory by creation order.
+ * PATH BUFFER POP: Takes the directory, the last
+ *    one pushed, from the end of the path.
  */
-void print_all(void* d, void* extra) {
-	struct Directory* dir = d;
+void pb_pop(struct PathBuf* pb, struct Directory* dir) {
+	pb->len -= dir->path->len + 1;
+}
 
-	/* This recursion doesn't require extra arguments */
-	(void)(extra);
+/*
+ * PATH BUFFER BUILD: Assembles the full path of
+ *    a directory, from the directory up to the
+ *    root, filling the buffer from its end.
+ */
+int pb_build(struct PathBuf* pb, struct Directory* dir) {
+	struct Directory* d;
+	size_t n, len = 0;
 
-	if (dir != NULL) {
-		if (dir->value != NULL) {
-			print_dir_full_path(dir);
-			printf(" %s\n", dir->value);
-		}
+	for (d = dir; d->p != NULL; d = d->p)
+		len += d->path->len + 1;
+	if (!pb_reserve(pb, len))
+		return 0;
 
-		avl_traverse(dir->subdirs_by_id, print_all, NULL);
+	pb->len = len;
+	for (d = dir; d->p != NULL; d = d->p) {
+		n = d->path->len;
+		len -= n;
+		memcpy(pb->s + len, d->path->str, n);
+		pb->s[--len] = '/';
 	}
+	return 1;
 }
 
 /*
- * REMOVE DIRECTORY: Removes a directory and all
- *    its subdirectories.
+ * PATH BUFFER KEY: Every thread assembles paths
+ *    in a buffer of its own.
  */
-void remove_directory(void* d, void* extra) {
-	struct Directory* dir = d;
-
-	if (dir != NULL) {
-		if (dir->value != NULL) {
-			struct FS* fs = extra;
-			fs->lookup = ht_remove(fs->lookup, dir, dir_value, cmp_ids);
-			free(dir->value);
-		}
+static pthread_key_t pb_key;
+static pthread_once_t pb_once = PTHREAD_ONCE_INIT;
 
-		/* Call this function on every subdirectory */
-		avl_traverse(dir->subdirs_by_id, remove_directory, extra);
+/*
+ * FREE PATH BUFFER: Frees the buffer of a thread
+ *    that exited.
+ */
+void free_pb(void* p) {
+	struct PathBuf* pb = p;
 
-		avl_destroy(dir->subdirs_by_path);
-		avl_destroy(dir->subdirs_by_id);
-		free(dir->path);
-		free(dir);
-	}
+	free(pb->s);
+	free(pb);
 }
 
 /*
- * CREATE DIRECTORY: Creates a directory and any
- *    necessary parent directories.
+ * CREATE PATH BUFFER KEY
  */
-struct Directory* create_directory(struct Directory* dir, char* path) {
-	struct Directory* sub;
-	char* rel_path = strtok(path, PATH_DELIMITER);
+void create_pb_key() {
+	pthread_key_create(&pb_key, free_pb);
+}
 
-	if (rel_path == NULL)
-		return dir;
+/*
+ * THREAD PATH BUFFER: Returns the buffer of the
+ *    calling thread, creating it if needed, or
+ *    NULL if it fails to allocate memory.
+ */
+struct PathBuf* thread_pb() {
+	struct PathBuf* pb;
 
-	sub = avl_find(dir->subdirs_by_path, rel_path, search_path);
+	pthread_once(&pb_once, create_pb_key);
+	pb = pthread_getspecific(pb_key);
+	if (pb != NULL)
+		return pb;
 
-	/* If directory doesn't exist create it */
-	if (sub == NULL) {
-		sub = new_directory(rel_path, dir->depth + 1);
-		if (sub == NULL)
-			return NULL;
-		sub->p = dir;
-		dir->subdirs_by_id = avl_insert(dir->subdirs_by_id, sub, cmp_ids);
-		dir->subdirs_by_path = avl_insert(dir->subdirs_by_path, sub, cmp_paths);
-		if (dir->subdirs_by_id == NULL || dir->subdirs_by_path == NULL)
-			return NULL;
+	pb = malloc(sizeof(struct PathBuf));
+	if (pb == NULL)
+		return NULL;
+	pb->s = NULL;
+	pb->len = pb->cap = 0;
+	pb->oom = 0;
+	if (pthread_setspecific(pb_key, pb) != 0) {
+		free(pb);
+		return NULL;
 	}
-
-	return create_directory(sub, NULL);
+	return pb;
 }
 
 /*
- * FIND DIRECTORY: Follows the given path and
- *    returns the directory if found.
+ * GENERATIONS: Last generation given to a
+ *    filesystem and amount of filesystems not
+ *    destroyed yet, by any thread.
  */
-struct Directory* find_directory(struct Directory* dir, char* path) {
-	struct Directory* sub;
-	char* rel_path;
+static unsigned long last_gen;
+static int live_fs;
+static pthread_mutex_t gen_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-	if (dir == NULL)
-		return NULL;
+/*
+ * NEW GENERATION: Moves a filesystem to a
+ *    generation no filesystem had before.
+ */
+void new_gen(struct FS* fs) {
+	pthread_mutex_lock(&gen_mutex);
+	fs->gen = ++last_gen;
+	pthread_mutex_unlock(&gen_mutex);
+}
 
-	if ((rel_path = strtok(path, PATH_DELIMITER)) == NULL)
-		return dir;
+/*
+ * COUNT FILESYSTEMS: Adds the given amount to
+ *    the filesystems not destroyed yet, returns
+ *    how many there are then.
+ */
+int count_fs(int n) {
+	int live;
 
-	sub = avl_find(dir->subdirs_by_path, rel_path, search_path);
-	if (sub == NULL)
-		return NULL;
-	else
-		return find_directory(sub, NULL);
+	pthread_mutex_lock(&gen_mutex);
+	live = live_fs += n;
+	pthread_mutex_unlock(&gen_mutex);
+	return live;
 }
 
 /*
- * FILESYSTEM INIT: Creates a new filesystem.
+ * PATH CACHE KEY: Every thread caches the paths
+ *    it resolves in a cache of its own, shared by
+ *    every filesystem it uses.
  */
-struct FS* fs_init() {
-	struct FS* fs = malloc(sizeof(struct FS));
-	if (fs == NULL)
-		return NULL;
-	fs->root = NULL;
-	fs->lookup = NULL;
-	return fs;
+static pthread_key_t cache_key;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+/*
+ * FREE CACHE: Frees the cache of a thread that
+ *    exited.
+ */
+void free_cache(void* c) {
+	cache_destroy(c);
 }
 
 /*
- * FILESYSTEM SET: Sets value for a given path.
- * - ERR_NO_MEMORY: The program failed to
- *    allocate memory.
+ * CREATE CACHE KEY
  */
-int fs_set(struct FS* fs, char* path, char* value) {
-	struct Directory* dir;
+void create_cache_key() {
+	pthread_key_create(&cache_key, free_cache);
+}
 
-	if (fs->root == NULL) {
-		fs->root = new_directory(FS_ROOT, 0);
-		if (fs->root == NULL)
-			return ERR_NO_MEMORY;
-	}
+/*
+ * THREAD CACHE: Returns the path cache of the
+ *    calling thread, creating it if needed, or
+ *    NULL if it fails to allocate memory.
+ */
+struct Cache* thread_cache() {
+	struct Cache* c;
 
-	dir = create_directory(fs->root, path);
-	if (dir == NULL)
-		return ERR_NO_MEMORY;
+	pthread_once(&cache_once, create_cache_key);
+	c = pthread_getspecific(cache_key);
+	if (c != NULL)
+		return c;
 
-	if (dir->value != NULL) {
-		fs->lookup = ht_remove(fs->lookup, dir, dir_value, cmp_ids);
-		free(dir->value);
+	c = cache_new(CACHE_SZ);
+	if (c == NULL)
+		return NULL;
+	if (pthread_setspecific(cache_key, c) != 0) {
+		cache_destroy(c);
+		return NULL;
 	}
-	dir->value = strdup(value);
-	if (dir->value == NULL)
-		return ERR_NO_MEMORY;
-
-	fs->lookup = ht_insert(fs->lookup, dir, dir_value);
-	if (fs->lookup == NULL)
-		return ERR_NO_MEMORY;
-
-	return OK;
+	return c;
 }
 
 /*
- * FILESYSTEM FIND: Print the value in a given
- *    path.
- * - ERR_NOT_FOUND: The directory does not exist.
- * - ERR_NO_DATA: The path has no value.
+ * FINGER KEY: Every thread follows paths with a
+ *    finger of its own.
  */
-int fs_find(struct FS* fs, char* path) {
-	struct Directory* dir = find_directory(fs->root, path);
-
-	if (dir == NULL)
-		return ERR_NOT_FOUND;
-	else if (dir->value == NULL)
-		return ERR_NO_DATA;
+static pthread_key_t finger_key;
+static pthread_once_t finger_once = PTHREAD_ONCE_INIT;
 
-	printf("%s\n", dir->value);
+/*
+ * FREE FINGER: Frees the finger of a thread that
+ *    exited.
+ */
+void free_finger(void* p) {
+	struct Finger* f = p;
 
-	return OK;
+	free(f->dirs);
+	free(f);
 }
 
 /*
- * FILESYSTEM LIST: Print relative path of all of
- *    the path's subdirectories.
- * - ERR_NOT_FOUND: The directory does not exist.
+ * CREATE FINGER KEY
  */
-int fs_list(struct FS* fs, char* path) {
-	struct Directory* dir = find_directory(fs->root, path);
-
-	if (dir == NULL)
-		return ERR_NOT_FOUND;
-
-	avl_traverse(dir->subdirs_by_path, print_dir_relative_path, NULL);
-
-	return OK;
+void create_finger_key() {
+	pthread_key_create(&finger_key, free_finger);
 }
 
 /*
- * FILESYSTEM SEARCH: Print full path of the most
- *    directory with the given value.
- * - ERR_NOT_FOUND: The value was not found.
+ * THREAD FINGER: Returns the finger of the
+ *    calling thread, creating it if needed, or
+ *    NULL if it fails to allocate memory.
  */
-int fs_search(struct FS* fs, char* v) {
-	struct Directory* dir = ht_search(fs->lookup, v, dir_value, more_recent);
+struct Finger* thread_finger() {
+	struct Finger* f;
 
-	if (dir == NULL)
-		return ERR_NOT_FOUND;
+	pthread_once(&finger_once, create_finger_key);
+	f = pthread_getspecific(finger_key);
+	if (f != NULL)
+		return f;
 
-	print_dir_full_path(dir);
-	printf("\n");
-
-	return OK;
+	f = malloc(sizeof(struct Finger));
+	if (f == NULL)
+		return NULL;
+	f->dirs = NULL;
+	f->len = f->cap = 0;
+	f->gen = 0;
+	if (pthread_setspecific(finger_key, f) != 0) {
+		free(f);
+		return NULL;
+	}
+	return f;
 }
 
 /*
- * FILESYSTEM REMOVE: Remove the directory with.
- *    a given path.
- * - ERR_NOT_FOUND: The directory does not exist.
+ * PRINT DIRECTORY RELATIVE PATH
  */
-int fs_remove(struct FS* fs, char* path) {
-	struct Directory* dir = find_directory(fs->root, path);
-
-	if (dir == NULL)
-		return ERR_NOT_FOUND; /* Not found */
+void print_dir_relative_path(void* d, void* extra) {
+	struct Directory* dir = d;
 
-	if (dir->p != NULL) {
-		dir->p->subdirs_by_path =
-			avl_remove(dir->p->subdirs_by_path, dir, cmp_paths);
-		dir->p->subdirs_by_id =
-			avl_remove(dir->p->subdirs_by_id, dir, cmp_ids);
-	}
+	/* No extra arguments are needed */
+	(void)extra;
 
-	remove_directory(dir, fs);
+	out_mem(dir->path->str, dir->path->len);
+	out_chr('\n');
+}
 
-	if (dir == fs->root) {
-		fs->root = NULL;
-		ht_destroy(fs->lookup);
-		fs->lookup = NULL;
+/*
+ * PRINT DIRECTORY FULL PATH: Prints the path in
+ *    the buffer, which must be the given
+ *    directory's full path.
+ */
+void print_dir_full_path(struct PathBuf* pb, struct Directory* dir) {
+	if (dir->p == NULL) {
+		out_chr('/');
+		out_mem(dir->path->str, dir->path->len);
+	} else {
+		out_mem(pb->s, pb->len);
 	}
-
-	return OK;
 }
 
 /*
- * FILESYSTEM PRINT: Print the full path of every
- *    directory by creation order.
+ * LIVE: Returns the given directory, or the
+ *    first sibling after it that wasn't removed,
+ *    NULL if there is none.
  */
-int fs_print(struct FS* fs) {
-	print_all(fs->root, NULL);
+struct Directory* live(struct Directory* dir) {
+	while (dir != NULL && dir->died != ALIVE)
+		dir = dir->next;
+	return dir;
+}
+
+/*
+ * VISIBLE: Returns the given directory, or the
+ *    first sibling after it the snapshot of the
+ *    given epoch sees, NULL if there is none.
+ */
+struct Directory* visible(struct Directory* dir, int s) {
+	while (dir != NULL && (dir->born > s || dir->died <= s))
+		dir = dir->next;
+	return dir;
+}
+
+/*
+ * PRINT FROM: Print the full path and value of
+ *    up to count directories of top's subtree by
+ *    creation order, starting at dir, one of
+ *    them, or of all of them if count is
+ *    negative. The tree is walked through the
+ *    parent and sibling links and the buffer,
+ *    holding the path of the given directory,
+ *    keeps the path of the current one.
+ */
+void print_from(struct PathBuf* pb, struct Directory* top,
+                struct Directory* dir, int count) {
+	struct Directory* sub;
+
+	while (count != 0) {
+		if (dir->value != NULL) {
+			print_dir_full_path(pb, dir);
+			out_chr(' ');
+			out_mem(dir->value->str, dir->value->len);
+			out_chr('\n');
+			if (count > 0)
+				count--;
+		}
+
+		if ((sub = live(dir->first)) == NULL) {
+			/* Go back up to the next directory not visited */
+			while (dir != top && (sub = live(dir->next)) == NULL) {
+				pb_pop(pb, dir);
+				dir = dir->p;
+			}
+			if (dir == top)
+				return;
+			pb_pop(pb, dir);
+		}
+		dir = sub;
+		if (!pb_push(pb, dir))
+			return;
+	}
+}
+
+/*
+ * NEW NAME: Creates a name in the arena.
+ */
+struct Name* new_name(struct FS* fs, char* str, size_t len,
+                                            unsigned int hash) {
+	size_t i;
+	struct Name* name = arena_alloc(fs->strs, sizeof(struct Name) + len);
+	if (name == NULL)
+		return NULL;
+
+	name->len = len;
+	name->hash = hash;
+	name->refs = 0;
+	memcpy(name->str, str, len + 1);
+	for (name->pfx = 0, i = 0; i < sizeof(unsigned long); i++)
+		name->pfx = name->pfx << 8 | (i < len ? (unsigned char)str[i] : 0);
+	return name;
+}
+
+/*
+ * INTERN: Returns the interned name with the
+ *    given string, creating it if needed.
+ */
+struct Name* intern(struct FS* fs, char* str) {
+	size_t len = strlen(str);
+	unsigned int hash = ht_hash_len(str, len);
+	struct Name* name = ht_find_hashed(fs->names, str, hash, name_str);
+
+	if (name == NULL) {
+		name = new_name(fs, str, len, hash);
+		if (name == NULL)
+			return NULL;
+		fs->names = ht_insert_hashed(fs->names, name, hash);
+		if (fs->names == NULL)
+			return NULL;
+	}
+
+	return name;
+}
+
+/*
+ * DROP NAME: Drops a directory's reference to
+ *    its name, the last one takes the name out
+ *    of the table and frees it.
+ */
+void drop_name(struct FS* fs, struct Name* name) {
+	if (--name->refs > 0)
+		return;
+	fs->names = ht_remove_hashed(fs->names, name, name->hash, same_name);
+	arena_free(fs->strs, name, sizeof(struct Name) + name->len);
+}
+
+/*
+ * NEW VALUE: Creates a value in the arena, held
+ *    by no directory.
+ */
+struct Value* new_value(struct FS* fs, char* str, size_t len,
+                                              unsigned int hash) {
+	struct Value* val = arena_alloc(fs->strs, sizeof(struct Value) + len);
+	if (val == NULL)
+		return NULL;
+
+	val->holders = NULL;
+	val->len = len;
+	val->hash = hash;
+	val->refs = 0;
+	memcpy(val->str, str, len + 1);
+	return val;
+}
+
+/*
+ * INTERN VALUE: Returns the interned value with
+ *    the given string, creating it if needed.
+ */
+struct Value* intern_value(struct FS* fs, char* str) {
+	size_t len = strlen(str);
+	unsigned int hash = ht_hash_len(str, len);
+	struct Value* val = ht_find_hashed(fs->lookup, str, hash, value_str);
+
+	if (val == NULL) {
+		val = new_value(fs, str, len, hash);
+		if (val == NULL)
+			return NULL;
+		fs->lookup = ht_insert_hashed(fs->lookup, val, hash);
+		if (fs->lookup == NULL)
+			return NULL;
+	}
+
+	return val;
+}
+
+/*
+ * HOLD VALUE: Assigns a value to a directory.
+ *    Returns 0 if it fails to allocate memory.
+ */
+int hold_value(struct FS* fs, struct Directory* dir, struct Value* val) {
+	val->holders = avl_insert(val->holders, dir, cmp_order, fs->nodes);
+	if (val->holders == NULL)
+		return 0;
+	dir->value = val;
+	return 1;
+}
+
+/*
+ * UNHOLD VALUE: Takes the value from a directory,
+ *    returns the value if no directory holds it
+ *    anymore or NULL otherwise.
+ */
+struct Value* unhold_value(struct FS* fs, struct Directory* dir) {
+	struct Value* val = dir->value;
+
+	val->holders = avl_remove(val->holders, dir, cmp_order, fs->nodes);
+	dir->value = NULL;
+
+	return val->holders == NULL ? val : NULL;
+}
+
+/*
+ * FREE VALUE: Frees a value out of the lookup
+ *    table, unless a snapshot still holds it.
+ */
+void free_value(struct FS* fs, struct Value* val) {
+	if (val->refs == 0)
+		arena_free(fs->strs, val, sizeof(struct Value) + val->len);
+}
+
+/*
+ * UNPIN VALUE: Drops a reference a snapshot held
+ *    to a value, freeing it if it was the last
+ *    thing holding it.
+ */
+void unpin_value(struct FS* fs, struct Value* val) {
+	val->refs--;
+	if (val->holders == NULL)
+		free_value(fs, val);
+}
+
+/*
+ * DROP VALUE: Takes the value from a directory,
+ *    values no directory holds are freed.
+ */
+void drop_value(struct FS* fs, struct Directory* dir) {
+	struct Value* val = unhold_value(fs, dir);
+
+	if (val != NULL) {
+		fs->lookup = ht_remove_hashed(fs->lookup, val, val->hash, cmp_values);
+		free_value(fs, val);
+	}
+}
+
+/*
+ * KEEP VALUE: Frees the value if no directory
+ *    holds it, returns true if it is kept.
+ */
+int keep_value(void* v, void* extra) {
+	struct Value* val = v;
+	struct FS* fs = extra;
+
+	if (val->holders != NULL)
+		return 1;
+	free_value(fs, val);
+	return 0;
+}
+
+/*
+ * INDEX DIRECTORY: Adds a directory to the index
+ *    given as extra argument.
+ */
+void index_directory(void* d, void* extra) {
+	struct Index* idx = extra;
+	struct Directory* dir = d;
+
+	if (idx->ht != NULL)
+		idx->ht = ht_insert_hashed(idx->ht, dir, dir->path->hash);
+}
+
+/*
+ * BUILD INDEX: Creates the hash index of a wide
+ *    directory with all of its subdirectories.
+ *    The directory stays without one if it
+ *    fails to allocate memory.
+ */
+void build_index(struct FS* fs, struct Directory* dir) {
+	struct Directory* sub;
+	struct Index* idx = malloc(sizeof(struct Index));
+	if (idx == NULL)
+		return;
+
+	idx->ht = ht_new(dir->n_subdirs);
+	for (sub = live(dir->first); sub != NULL && idx->ht != NULL;
+	                                  sub = live(sub->next))
+		index_directory(sub, idx);
+	if (idx->ht == NULL) {
+		free(idx);
+		return;
+	}
+
+	idx->prev = NULL;
+	idx->next = fs->indexes;
+	if (fs->indexes != NULL)
+		fs->indexes->prev = idx;
+	fs->indexes = idx;
+	dir->index = idx;
+}
+
+/*
+ * DROP INDEX: Frees the hash index of a
+ *    directory, if it has one.
+ */
+void drop_index(struct FS* fs, struct Directory* dir) {
+	struct Index* idx = dir->index;
+
+	if (idx == NULL)
+		return;
+
+	if (idx->prev != NULL)
+		idx->prev->next = idx->next;
+	else
+		fs->indexes = idx->next;
+	if (idx->next != NULL)
+		idx->next->prev = idx->prev;
+
+	if (idx->ht != NULL)
+		ht_destroy(idx->ht);
+	free(idx);
+	dir->index = NULL;
+}
+
+/*
+ * FIND SUBDIRECTORY: Returns the subdirectory
+ *    with the given relative path, or NULL.
+ */
+struct Directory* find_subdir(struct Directory* dir, struct Name* rel_path) {
+	if (dir->index != NULL)
+		return ht_find_hashed(dir->index->ht, rel_path->str, rel_path->hash,
+		                                                        dir_path);
+	return avl_find(dir->subdirs_by_path, rel_path, search_path);
+}
+
+/*
+ * GONE PUSH: Adds a value no directory holds to
+ *    the list of the current removal, values
+ *    that don't fit are freed right away.
+ */
+void gone_push(struct FS* fs, struct Value* val) {
+	struct ValueList* l = &fs->gone;
+	struct Value** vals;
+	size_t cap = l->cap > 0 ? l->cap * 2 : 256;
+
+	if (l->len == l->cap) {
+		vals = realloc(l->vals, cap * sizeof(struct Value*));
+		if (vals == NULL) {
+			fs->lookup = ht_remove_hashed(fs->lookup, val, val->hash, cmp_values);
+			free_value(fs, val);
+			return;
+		}
+		l->vals = vals;
+		l->cap = cap;
+	}
+	l->vals[l->len++] = val;
+}
+
+/*
+ * DROP GONE: Takes the values collected by a
+ *    removal out of the lookup table and frees
+ *    them. When they are a big part of the table
+ *    it is rebuilt once instead of removing them
+ *    one at a time.
+ */
+void drop_gone(struct FS* fs) {
+	struct ValueList* l = &fs->gone;
+	struct Value* val;
+	size_t i;
+
+	if (l->len * BULK_FRACTION >= (size_t)ht_size(fs->lookup)) {
+		fs->lookup = ht_filter(fs->lookup, keep_value, fs);
+	} else {
+		for (i = 0; i < l->len; i++) {
+			val = l->vals[i];
+			fs->lookup = ht_remove_hashed(fs->lookup, val, val->hash, cmp_values);
+			free_value(fs, val);
+		}
+	}
+	l->len = 0;
+}
+
+/*
+ * REMOVE DIRECTORY: Removes a directory and all
+ *    its subdirectories in a single pass. The
+ *    values left unused are collected and taken
+ *    out of the lookup table together at the
+ *    end. A removed directory kept for the
+ *    snapshots only drops the references they
+ *    held to the values.
+ */
+void remove_directory(struct FS* fs, struct Directory* top) {
+	struct Directory* dir = top;
+	struct Directory* p;
+	struct Value* val;
+	int buried = top->died != ALIVE;
+
+	for (;;) {
+		/* Subdirectories are removed before their parent */
+		if (dir->first != NULL) {
+			p = dir;
+			dir = dir->first;
+			p->first = dir->next;
+			continue;
+		}
+
+		if (dir->value != NULL && buried)
+			unpin_value(fs, dir->value);
+		else if (dir->value != NULL && (val = unhold_value(fs, dir)) != NULL)
+			gone_push(fs, val);
+		avl_destroy(dir->subdirs_by_path, fs->nodes);
+		drop_index(fs, dir);
+
+		p = dir == top ? NULL : dir->p;
+		drop_name(fs, dir->path);
+		pool_free(fs->dirs, dir);
+		if (p == NULL)
+			break;
+		dir = p;
+	}
+
+	drop_gone(fs);
+}
+
+/*
+ * RELEASE MEMORY: Frees every directory, AVL node
+ *    and string at once.
+ */
+void release_memory(struct FS* fs) {
+	while (fs->indexes != NULL) {
+		struct Index* idx = fs->indexes;
+		fs->indexes = idx->next;
+		if (idx->ht != NULL)
+			ht_destroy(idx->ht);
+		free(idx);
+	}
+	if (fs->names != NULL)
+		ht_destroy(fs->names);
+	fs->names = NULL;
+	pool_destroy(fs->dirs);
+	pool_destroy(fs->nodes);
+	pool_destroy(fs->versions);
+	arena_destroy(fs->strs);
+	fs->dirs = fs->nodes = fs->versions = NULL;
+	fs->strs = NULL;
+}
+
+/*
+ * LINK DIRECTORY: Makes a directory the newest
+ *    subdirectory of the given parent. Returns 0
+ *    if it fails to allocate memory.
+ */
+int link_directory(struct FS* fs, struct Directory* p, struct Directory* dir) {
+	p->subdirs_by_path = avl_insert(p->subdirs_by_path, dir, cmp_paths, fs->nodes);
+	if (p->subdirs_by_path == NULL)
+		return 0;
+
+	dir->p = p;
+	order_insert(&dir->open, &p->close);
+	order_insert(&dir->close, &p->close);
+	dir->prev = p->last;
+	if (p->last != NULL)
+		p->last->next = dir;
+	else
+		p->first = dir;
+	p->last = dir;
+
+	/* Wide directories get a hash index */
+	p->n_subdirs++;
+	if (p->index != NULL) {
+		p->index->ht = ht_insert_hashed(p->index->ht, dir, dir->path->hash);
+		if (p->index->ht == NULL)
+			return 0;
+	} else if (p->n_subdirs >= INDEX_THRESHOLD) {
+		build_index(fs, p);
+	}
+	return 1;
+}
+
+/*
+ * GROW SIZES: Counts n new directories, the last
+ *    ones down the path to the given one, in the
+ *    size of every directory above them.
+ */
+void grow_sizes(struct Directory* dir, int n) {
+	int i;
+
+	if (n == 0)
+		return;
+	for (i = 1; i < n; i++) {
+		dir = dir->p;
+		dir->size = i + 1;
+	}
+	for (dir = dir->p; dir != NULL; dir = dir->p)
+		dir->size += n;
+}
+
+/*
+ * SHRINK SIZES: Takes n directories from the
+ *    size of every directory above the given one.
+ */
+void shrink_sizes(struct Directory* dir, int n) {
+	for (dir = dir->p; dir != NULL; dir = dir->p)
+		dir->size -= n;
+}
+
+/*
+ * DETACH DIRECTORY: Takes a directory out of its
+ *    parent's AVL, index and size, where it can't
+ *    be found anymore, leaving it in the list of
+ *    its siblings.
+ */
+void detach_directory(struct FS* fs, struct Directory* dir) {
+	struct Directory* p = dir->p;
+
+	p->subdirs_by_path = avl_remove(p->subdirs_by_path, dir, cmp_paths, fs->nodes);
+	shrink_sizes(dir, dir->size);
+
+	/* Narrow directories go back to searching the AVL */
+	p->n_subdirs--;
+	if (p->index != NULL) {
+		p->index->ht = ht_remove_hashed(p->index->ht, dir, dir->path->hash,
+		                                                         cmp_ids);
+		if (p->n_subdirs < INDEX_THRESHOLD / 2)
+			drop_index(fs, p);
+	}
+}
+
+/*
+ * UNLINK SIBLING: Takes a directory out of the
+ *    list of its siblings.
+ */
+void unlink_sibling(struct Directory* dir) {
+	if (dir->prev != NULL)
+		dir->prev->next = dir->next;
+	else
+		dir->p->first = dir->next;
+	if (dir->next != NULL)
+		dir->next->prev = dir->prev;
+	else
+		dir->p->last = dir->prev;
+}
+
+/*
+ * UNLINK DIRECTORY: Takes a directory out of its
+ *    parent's subdirectories.
+ */
+void unlink_directory(struct FS* fs, struct Directory* dir) {
+	detach_directory(fs, dir);
+	unlink_sibling(dir);
+}
+
+/*
+ * NEXT NAME: Cuts the next relative path out of
+ *    the given path, which is moved past it.
+ *    Returns NULL at its end. Unlike strtok it
+ *    keeps no state between calls, so threads
+ *    can follow paths at the same time.
+ */
+char* next_name(char** path) {
+	char* name = *path + strspn(*path, PATH_DELIMITER);
+	char* end;
+
+	if (*name == '\0')
+		return NULL;
+	end = name + strcspn(name, PATH_DELIMITER);
+	if (*end != '\0')
+		*end++ = '\0';
+	*path = end;
+	return name;
+}
+
+/*
+ * CREATE DIRECTORY: Creates a directory and any
+ *    necessary parent directories.
+ */
+struct Directory* create_directory(struct FS* fs, struct Directory* dir,
+                                                               char* path) {
+	struct Directory* sub;
+	struct Name* name;
+	char* rel_path;
+	int n = 0;
+
+	while ((rel_path = next_name(&path)) != NULL) {
+		name = intern(fs, rel_path);
+		if (name == NULL)
+			return NULL;
+		sub = find_subdir(dir, name);
+
+		/* If directory doesn't exist create it */
+		if (sub == NULL) {
+			sub = new_directory(fs, name);
+			if (sub == NULL || !link_directory(fs, dir, sub)) {
+				grow_sizes(dir, n);
+				return NULL;
+			}
+			n++;
+		}
+		dir = sub;
+	}
+
+	grow_sizes(dir, n);
+	return dir;
+}
+
+/*
+ * FIND DIRECTORY: Follows the given path and
+ *    returns the directory if found.
+ */
+struct Directory* find_directory(struct FS* fs, struct Directory* dir,
+                                                             char* path) {
+	struct Name* name;
+	char* rel_path;
+
+	if (dir == NULL)
+		return NULL;
+
+	while ((rel_path = next_name(&path)) != NULL) {
+		/* A path that was never interned can't exist */
+		name = ht_find(fs->names, rel_path, name_str);
+		if (name == NULL)
+			return NULL;
+
+		dir = find_subdir(dir, name);
+		if (dir == NULL)
+			return NULL;
+	}
+
+	return dir;
+}
+
+/*
+ * FINGER PUT: Places a directory at the given
+ *    depth of the finger, the ones past it are
+ *    dropped. Returns 0 if it fails to allocate
+ *    memory, the finger is then left empty.
+ */
+int finger_put(struct Finger* f, int depth, struct Directory* dir) {
+	struct Directory** dirs;
+	int cap;
+
+	if (depth >= f->cap) {
+		cap = f->cap > 0 ? f->cap * 2 : 16;
+		dirs = realloc(f->dirs, cap * sizeof(struct Directory*));
+		if (dirs == NULL) {
+			f->len = 0;
+			return 0;
+		}
+		f->dirs = dirs;
+		f->cap = cap;
+	}
+	f->dirs[depth] = dir;
+	f->len = depth + 1;
+	return 1;
+}
+
+/*
+ * FOLLOW PATH: Follows the given path from the
+ *    root like find_directory, or create_directory
+ *    if create is set, but the relative paths it
+ *    shares with the finger's path are matched
+ *    against the finger instead of looked up, so
+ *    following paths in the same directory one
+ *    after the other only looks up the last one.
+ *    The finger is moved to the path, or as far
+ *    along it as it was followed.
+ */
+struct Directory* follow_path(struct FS* fs, struct Finger* f, char* path,
+                                                             int create) {
+	struct Directory *dir = fs->root, *sub = NULL;
+	struct Name* name;
+	char* rel_path;
+	int depth = 0, n = 0;
+	int same = f->gen == fs->gen && f->len > 0 && f->dirs[0] == dir;
+
+	if (dir == NULL)
+		return NULL;
+	if (!same) {
+		f->gen = fs->gen;
+		finger_put(f, 0, dir);
+	}
+
+	while ((rel_path = next_name(&path)) != NULL) {
+		if (same && depth + 1 < f->len &&
+		    strcmp(f->dirs[depth + 1]->path->str, rel_path) == 0) {
+			dir = f->dirs[++depth];
+			continue;
+		}
+		same = 0;
+
+		/* A path that was never interned can't exist */
+		name = create ? intern(fs, rel_path) :
+		                ht_find(fs->names, rel_path, name_str);
+		sub = name != NULL ? find_subdir(dir, name) : NULL;
+		if (sub == NULL && create && name != NULL) {
+			sub = new_directory(fs, name);
+			if (sub != NULL && !link_directory(fs, dir, sub))
+				sub = NULL;
+			n += sub != NULL;
+		}
+		if (sub == NULL)
+			break;
+
+		dir = sub;
+		if (f->len > 0)
+			finger_put(f, ++depth, dir);
+	}
+
+	grow_sizes(dir, n);
+	if (!same && f->len > depth + 1)
+		f->len = depth + 1;
+	return rel_path == NULL ? dir : NULL;
+}
+
+/*
+ * RESTORE PATH: Puts back the delimiters a path
+ *    of the given length was cut at.
+ */
+void restore_path(char* path, size_t len) {
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (path[i] == '\0')
+			path[i] = PATH_DELIMITER[0];
+}
+
+/*
+ * ELAPSED: Returns the nanoseconds since start.
+ */
+unsigned long elapsed(struct timespec* start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000000UL +
+	       now.tv_nsec - start->tv_nsec;
+}
+
+/*
+ * WALK PATH: Follows the given path from the
+ *    root with the thread's finger, or without
+ *    it if it can't be had.
+ */
+struct Directory* walk_path(struct FS* fs, char* path, int create) {
+	struct Finger* f = thread_finger();
+
+	if (f != NULL)
+		return follow_path(fs, f, path, create);
+	return create ? create_directory(fs, fs->root, path) :
+	                find_directory(fs, fs->root, path);
+}
+
+/*
+ * RESOLVE PATH: Follows the given path from the
+ *    root, creating the missing directories if
+ *    create is set, and returns the directory, or
+ *    NULL if it isn't found or it fails to
+ *    allocate memory. Paths the thread resolved
+ *    before take a single probe of its cache, as
+ *    long as nothing was removed since. One in
+ *    CACHE_SAMPLE hits is timed, and one in
+ *    CACHE_SAMPLE misses, the first ones included.
+ */
+struct Directory* resolve_path(struct FS* fs, char* path, int create) {
+	struct Cache* c = thread_cache();
+	struct CacheStats* stats;
+	struct Directory* dir;
+	struct timespec start;
+	unsigned int hash;
+	size_t len;
+	int time_hit, time_miss;
+
+	if (c == NULL)
+		return walk_path(fs, path, create);
+
+	/* Whether it hits is only known after, either kind may be due */
+	stats = cache_stats(c);
+	time_hit = stats->hits % CACHE_SAMPLE == 0;
+	time_miss = stats->misses % CACHE_SAMPLE == 0;
+	if (time_hit || time_miss)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	len = strlen(path);
+	hash = ht_hash_len(path, len);
+	dir = cache_get(c, path, hash, fs->gen);
+	if (dir != NULL) {
+		if (time_hit) {
+			stats->hit_ns += elapsed(&start);
+			stats->hit_samples++;
+		}
+		return dir;
+	}
+
+	dir = walk_path(fs, path, create);
+	/* The cache is only a shortcut, failing to fill it changes nothing */
+	if (dir != NULL) {
+		restore_path(path, len);
+		cache_put(c, path, len, hash, dir, fs->gen);
+	}
+	if (time_miss) {
+		stats->miss_ns += elapsed(&start);
+		stats->miss_samples++;
+	}
+	return dir;
+}
+
+/*
+ * INIT POOLS: Creates the memory pools. Returns 0
+ *    if it fails to allocate memory.
+ */
+int init_pools(struct FS* fs) {
+	fs->dirs = pool_new(sizeof(struct Directory));
+	fs->nodes = avl_new_pool();
+	fs->versions = pool_new(sizeof(struct Version));
+	fs->strs = arena_new();
+	return fs->dirs != NULL && fs->nodes != NULL && fs->versions != NULL &&
+	                                                   fs->strs != NULL;
+}
+
+/*
+ * INIT ROOT: Creates the memory pools, unless a
+ *    snapshot kept them, and the root directory.
+ *    Returns 0 if it fails to allocate memory.
+ */
+int init_root(struct FS* fs) {
+	struct Name* name;
+
+	if (fs->dirs == NULL && !init_pools(fs))
+		return 0;
+	name = intern(fs, FS_ROOT);
+	if (name == NULL)
+		return 0;
+	fs->root = new_directory(fs, name);
+	if (fs->root == NULL)
+		return 0;
+	order_init(&fs->root->open, &fs->root->close);
+	return 1;
+}
+
+/*
+ * COPY DIRECTORY: Creates a copy of a directory,
+ *    with the same id and value, as the newest
+ *    subdirectory of the given parent, or as the
+ *    root if there is none. Returns NULL if it
+ *    fails to allocate memory.
+ */
+struct Directory* copy_directory(struct FS* fs, struct Directory* p,
+                                              struct Directory* dir) {
+	struct Directory* cp;
+	struct Name* name;
+	struct Value* val;
+
+	if (p == NULL) {
+		cp = fs->root;
+	} else {
+		name = intern(fs, dir->path->str);
+		if (name == NULL)
+			return NULL;
+		cp = new_directory(fs, name);
+		if (cp == NULL || !link_directory(fs, p, cp))
+			return NULL;
+	}
+
+	cp->id = dir->id;
+	cp->size = dir->size;
+	if (dir->value != NULL) {
+		val = intern_value(fs, dir->value->str);
+		if (val == NULL || !hold_value(fs, cp, val))
+			return NULL;
+	}
+	return cp;
+}
+
+/*
+ * SKIP: Returns the given directory, or its next
+ *    sibling if it is the one to skip.
+ */
+struct Directory* skip(struct Directory* dir, struct Directory* top) {
+	return dir == top ? dir->next : dir;
+}
+
+/*
+ * COPY TREE: Copies every directory of the tree
+ *    except the given subtree into the root of
+ *    another filesystem, walking both trees by
+ *    creation order. Returns 0 if it fails to
+ *    allocate memory.
+ */
+int copy_tree(struct FS* copy, struct Directory* root, struct Directory* top) {
+	struct Directory* dir = root;
+	struct Directory* cp = copy_directory(copy, NULL, root);
+	struct Directory* sub;
+
+	while (cp != NULL) {
+		if (dir->first != NULL && (sub = skip(dir->first, top)) != NULL) {
+			cp = copy_directory(copy, cp, sub);
+		} else {
+			while (dir != root && skip(dir->next, top) == NULL) {
+				dir = dir->p;
+				cp = cp->p;
+			}
+			if (dir == root)
+				return 1;
+			sub = skip(dir->next, top);
+			cp = copy_directory(copy, cp->p, sub);
+		}
+		dir = sub;
+	}
+
+	return 0;
+}
+
+/*
+ * EMPTY COPY: Starts a filesystem sharing the
+ *    given one's buffers but nothing else, to be
+ *    filled and then take its place.
+ */
+void empty_copy(struct FS* copy, struct FS* fs) {
+	*copy = *fs;
+	copy->root = NULL;
+	copy->lookup = NULL;
+	copy->dirs = copy->nodes = copy->versions = NULL;
+	copy->strs = NULL;
+	copy->indexes = NULL;
+	copy->names = NULL;
+}
+
+/*
+ * DISCARD COPY: Frees everything a copy holds.
+ */
+void discard_copy(struct FS* copy) {
+	if (copy->lookup != NULL)
+		ht_destroy(copy->lookup);
+	release_memory(copy);
+}
+
+/*
+ * REPLACE WITH: Frees every directory of the
+ *    filesystem and takes those of the copy.
+ */
+void replace_with(struct FS* fs, struct FS* copy) {
+	new_gen(fs);
+	if (fs->lookup != NULL)
+		ht_destroy(fs->lookup);
+	release_memory(fs);
+	fs->root = copy->root;
+	fs->lookup = copy->lookup;
+	fs->dirs = copy->dirs;
+	fs->nodes = copy->nodes;
+	fs->versions = copy->versions;
+	fs->strs = copy->strs;
+	fs->indexes = copy->indexes;
+	fs->names = copy->names;
+}
+
+/*
+ * REBUILD WITHOUT: Removes a big subtree by
+ *    copying every other directory into new
+ *    pools and releasing the old ones at once,
+ *    so the cost depends on what is kept and not
+ *    on what is removed. Returns 0 if it fails to
+ *    allocate memory, leaving the filesystem as
+ *    it was.
+ */
+int rebuild_without(struct FS* fs, struct Directory* top) {
+	struct FS copy;
+
+	empty_copy(&copy, fs);
+
+	/* The copies take the sizes without the subtree */
+	shrink_sizes(top, top->size);
+	if (!init_root(&copy) || !copy_tree(&copy, fs->root, top)) {
+		shrink_sizes(top, -top->size);
+		discard_copy(&copy);
+		return 0;
+	}
+
+	replace_with(fs, &copy);
+	return 1;
+}
+
+/************************************************
+ * LOADER: Snapshot being loaded.
+ * - h: Header of the mapped snapshot.
+ *
+ * - names, values, recs: Arrays of the snapshot.
+ *
+ * - strs: Strings of the snapshot.
+ *
+ * - name_of, value_of: Interned name and value
+ *    of each entry of the arrays.
+ *
+ * - dirs: Directory of each record.
+ *
+ * - base: Position of the first subdirectory of
+ *    each directory in els.
+ *
+ * - els: Subdirectories of every directory by
+ *    relative path, reused for the holders of
+ *    every value in the order they're printed.
+ *
+ * - ends: End of the holders of each value in
+ *    els.
+ *************************************************/
+struct Loader {
+	struct SnapHeader* h;
+	struct SnapStr *names, *values;
+	struct SnapDir* recs;
+	char* strs;
+	struct Name** name_of;
+	struct Value** value_of;
+	struct Directory** dirs;
+	int* base;
+	void** els;
+	int* ends;
+};
+
+/*
+ * SORT NAMES: Orders pointers to names, used to
+ *    sort them with qsort.
+ */
+int sort_names(const void* name1, const void* name2) {
+	return cmp_names(*(struct Name* const*)name1, *(struct Name* const*)name2);
+}
+
+/*
+ * SORT VALUES: Orders pointers to values by their
+ *    strings, used to sort them with qsort.
+ */
+int sort_values(const void* val1, const void* val2) {
+	return strcmp((*(struct Value* const*)val1)->str,
+	              (*(struct Value* const*)val2)->str);
+}
+
+/*
+ * UNIQUE: Drops the repeated pointers of a sorted
+ *    array, returns how many are left.
+ */
+size_t unique(void* ptrs, size_t n) {
+	void** a = ptrs;
+	size_t i, k = 0;
+
+	for (i = 0; i < n; i++)
+		if (k == 0 || a[i] != a[k - 1])
+			a[k++] = a[i];
+	return k;
+}
+
+/*
+ * POSITION: Returns the position of a pointer in
+ *    a sorted array of unique pointers.
+ */
+int position(void* ptr, void* ptrs, size_t n,
+             int (*cmp)(const void*, const void*)) {
+	void** a = ptrs;
+	return (void**)bsearch(&ptr, a, n, sizeof(void*), cmp) - a;
+}
+
+/*
+ * COLLECT DIRECTORIES: Lists every directory in
+ *    the order they're printed in and fills the
+ *    id, parent and rank of their records.
+ */
+void collect_dirs(struct FS* fs, struct Directory** dirs, struct SnapDir* recs) {
+	struct Directory* dir = fs->root;
+	struct Directory* sub;
+	int i = 0, parent = SNAP_NONE;
+
+	for (;;) {
+		dirs[i] = dir;
+		recs[i].id = dir->id;
+		recs[i].parent = parent;
+		recs[i].rank = parent == SNAP_NONE ? 0 :
+		               avl_rank(dir->p->subdirs_by_path, dir->path, search_path);
+
+		if ((sub = live(dir->first)) != NULL) {
+			parent = i;
+		} else {
+			/* Go back up to the next directory not visited */
+			while (dir->p != NULL && (sub = live(dir->next)) == NULL) {
+				dir = dir->p;
+				parent = recs[parent].parent;
+			}
+			if (dir->p == NULL)
+				return;
+		}
+		dir = sub;
+		i++;
+	}
+}
+
+/*
+ * SAVE SNAPSHOT: Writes every directory, with
+ *    the names and values they use, into a
+ *    snapshot stamped with the given log
+ *    generation, using the given arrays with
+ *    room for every directory.
+ * - ERR_IO: The snapshot couldn't be written.
+ */
+int save_snapshot(struct FS* fs, char* file, unsigned long gen,
+                  struct Directory** dirs, struct SnapDir* recs,
+                  struct Name** names, struct Value** vals) {
+	struct SnapHeader h;
+	struct SnapStr t;
+	struct SnapFile* f;
+	size_t i;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+	h.next_id = fs->next_id;
+	h.log_gen = gen;
+	if (fs->root != NULL) {
+		h.n_dirs = fs->root->size;
+		collect_dirs(fs, dirs, recs);
+	}
+
+	/* Names and values are stored once, sorted by string */
+	for (i = 0; i < h.n_dirs; i++) {
+		names[i] = dirs[i]->path;
+		if (dirs[i]->value != NULL)
+			vals[h.n_values++] = dirs[i]->value;
+	}
+	qsort(names, h.n_dirs, sizeof(struct Name*), sort_names);
+	qsort(vals, h.n_values, sizeof(struct Value*), sort_values);
+	h.n_names = unique(names, h.n_dirs);
+	h.n_values = unique(vals, h.n_values);
+
+	for (i = 0; i < h.n_dirs; i++) {
+		recs[i].name = position(dirs[i]->path, names, h.n_names, sort_names);
+		recs[i].value = dirs[i]->value == NULL ? SNAP_NONE :
+		        position(dirs[i]->value, vals, h.n_values, sort_values);
+	}
+	for (i = 0; i < h.n_names; i++)
+		h.strs_sz += names[i]->len + 1;
+	for (i = 0; i < h.n_values; i++)
+		h.strs_sz += vals[i]->len + 1;
+
+	f = snap_create(file);
+	if (f == NULL)
+		return ERR_IO;
+
+	snap_write(f, &h, sizeof(h));
+	for (t.off = 0, i = 0; i < h.n_names; t.off += t.len + 1, i++) {
+		t.len = names[i]->len;
+		snap_write(f, &t, sizeof(t));
+	}
+	for (i = 0; i < h.n_values; t.off += t.len + 1, i++) {
+		t.len = vals[i]->len;
+		snap_write(f, &t, sizeof(t));
+	}
+	snap_write(f, recs, h.n_dirs * sizeof(struct SnapDir));
+	for (i = 0; i < h.n_names; i++)
+		snap_write(f, names[i]->str, names[i]->len + 1);
+	for (i = 0; i < h.n_values; i++)
+		snap_write(f, vals[i]->str, vals[i]->len + 1);
+
+	return snap_commit(f) ? OK : ERR_IO;
+}
+
+/*
+ * FITS: Takes n elements of the given size from
+ *    the bytes left in a snapshot, returns 0 if
+ *    they don't fit.
+ */
+int fits(size_t* left, size_t n, size_t el_sz) {
+	if (n > *left / el_sz)
+		return 0;
+	*left -= n * el_sz;
+	return 1;
+}
+
+/*
+ * OPEN LOADER: Finds the arrays of a mapped
+ *    snapshot, returns 0 if it isn't one.
+ */
+int open_loader(struct Loader* ld, void* map, size_t sz) {
+	size_t left = sz - sizeof(struct SnapHeader);
+	struct SnapHeader* h = map;
+
+	if (sz < sizeof(struct SnapHeader) ||
+	    memcmp(h->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) != 0)
+		return 0;
+	if (h->n_dirs > INT_MAX || h->n_names > INT_MAX || h->n_values > INT_MAX ||
+	    !fits(&left, h->n_names, sizeof(struct SnapStr)) ||
+	    !fits(&left, h->n_values, sizeof(struct SnapStr)) ||
+	    !fits(&left, h->n_dirs, sizeof(struct SnapDir)) || left != h->strs_sz)
+		return 0;
+
+	ld->h = h;
+	ld->names = (struct SnapStr*)(h + 1);
+	ld->values = ld->names + h->n_names;
+	ld->recs = (struct SnapDir*)(ld->values + h->n_values);
+	ld->strs = (char*)(ld->recs + h->n_dirs);
+	return 1;
+}
+
+/*
+ * LOAD STRING: Returns a string of the snapshot,
+ *    or NULL if it doesn't fit in the strings or
+ *    isn't as long as the table says.
+ */
+char* load_str(struct Loader* ld, struct SnapStr* t) {
+	char* str;
+
+	if (t->off >= ld->h->strs_sz || t->len >= ld->h->strs_sz - t->off)
+		return NULL;
+	str = ld->strs + t->off;
+	if (str[t->len] != '\0' || memchr(str, '\0', t->len) != NULL)
+		return NULL;
+	return str;
+}
+
+/*
+ * LOAD STRINGS: Interns every name and value of
+ *    the snapshot, each one is known to be
+ *    distinct so none is looked up.
+ * - ERR_IO: A string is broken.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int load_strs(struct FS* fs, struct Loader* ld) {
+	unsigned int i, hash;
+	struct SnapStr* t;
+	char* str;
+
+	/* The tables are made big enough for all of them at once */
+	fs->names = ht_new(ld->h->n_names);
+	fs->lookup = ht_new(ld->h->n_values);
+	if (fs->names == NULL || fs->lookup == NULL)
+		return ERR_NO_MEMORY;
+
+	for (i = 0; i < ld->h->n_names; i++) {
+		t = &ld->names[i];
+		if ((str = load_str(ld, t)) == NULL)
+			return ERR_IO;
+		hash = ht_hash_len(str, t->len);
+		ld->name_of[i] = new_name(fs, str, t->len, hash);
+		if (ld->name_of[i] == NULL)
+			return ERR_NO_MEMORY;
+		fs->names = ht_insert_hashed(fs->names, ld->name_of[i], hash);
+		if (fs->names == NULL)
+			return ERR_NO_MEMORY;
+	}
+
+	for (i = 0; i < ld->h->n_values; i++) {
+		t = &ld->values[i];
+		if ((str = load_str(ld, t)) == NULL)
+			return ERR_IO;
+		hash = ht_hash_len(str, t->len);
+		ld->value_of[i] = new_value(fs, str, t->len, hash);
+		if (ld->value_of[i] == NULL)
+			return ERR_NO_MEMORY;
+		fs->lookup = ht_insert_hashed(fs->lookup, ld->value_of[i], hash);
+		if (fs->lookup == NULL)
+			return ERR_NO_MEMORY;
+	}
+
+	return OK;
+}
+
+/*
+ * VALID RECORD: Checks a record of the snapshot
+ *    against the directories already loaded: its
+ *    parent must be the last one loaded or one of
+ *    its ancestors, so they are in the order
+ *    they're printed in, and ids must increase
+ *    down the tree and along the siblings.
+ */
+int valid_record(struct Loader* ld, int i) {
+	struct SnapDir* r = &ld->recs[i];
+	struct Directory *p, *last;
+
+	if (r->name < 0 || r->name >= (int)ld->h->n_names ||
+	    r->value < SNAP_NONE || r->value >= (int)ld->h->n_values ||
+	    r->id >= ld->h->next_id)
+		return 0;
+	if (i == 0)
+		return r->parent == SNAP_NONE && r->rank == 0;
+	if (r->parent < 0 || r->parent >= i)
+		return 0;
+
+	p = ld->dirs[r->parent];
+	for (last = ld->dirs[i - 1]; last != p; last = last->p)
+		if (last->p == NULL)
+			return 0;
+
+	return r->id > p->id && (p->last == NULL || r->id > p->last->id);
+}
+
+/*
+ * LOAD DIRECTORIES: Creates every directory of
+ *    the snapshot and links it to its parent,
+ *    then labels them all and counts the sizes.
+ * - ERR_IO: A record is broken.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int load_dirs(struct FS* fs, struct Loader* ld) {
+	struct Directory *dir, *p;
+	struct SnapDir* r;
+	int i, n = ld->h->n_dirs;
+
+	for (i = 0; i < n; i++) {
+		r = &ld->recs[i];
+		if (!valid_record(ld, i))
+			return ERR_IO;
+		dir = new_directory(fs, ld->name_of[r->name]);
+		if (dir == NULL)
+			return ERR_NO_MEMORY;
+		dir->id = r->id;
+		ld->dirs[i] = dir;
+
+		if (i == 0) {
+			fs->root = dir;
+			order_init(&dir->open, &dir->close);
+			continue;
+		}
+
+		p = ld->dirs[r->parent];
+		dir->p = p;
+		order_push(&dir->open, &p->close);
+		order_push(&dir->close, &p->close);
+		dir->prev = p->last;
+		if (p->last != NULL)
+			p->last->next = dir;
+		else
+			p->first = dir;
+		p->last = dir;
+		p->n_subdirs++;
+	}
+
+	order_spread(&fs->root->open, &fs->root->close);
+	for (i = n - 1; i > 0; i--)
+		ld->dirs[ld->recs[i].parent]->size += ld->dirs[i]->size;
+	return OK;
+}
+
+/*
+ * LOAD SUBDIRECTORIES: Places the subdirectories
+ *    of every directory by their rank and builds
+ *    their AVLs straight from that order, and the
+ *    hash index of the wide ones.
+ * - ERR_IO: The ranks don't order the
+ *    subdirectories.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int load_subdirs(struct FS* fs, struct Loader* ld) {
+	struct Directory *dir, *p;
+	void** els;
+	int i, j, slot, off = 0, n = ld->h->n_dirs;
+
+	for (i = 0; i < n; i++) {
+		ld->base[i] = off;
+		off += ld->dirs[i]->n_subdirs;
+		ld->els[i] = NULL;
+	}
+
+	for (i = 1; i < n; i++) {
+		p = ld->dirs[ld->recs[i].parent];
+		slot = ld->recs[i].rank;
+		if (slot < 0 || slot >= p->n_subdirs ||
+		    ld->els[ld->base[ld->recs[i].parent] + slot] != NULL)
+			return ERR_IO;
+		ld->els[ld->base[ld->recs[i].parent] + slot] = ld->dirs[i];
+	}
+
+	for (i = 0; i < n; i++) {
+		dir = ld->dirs[i];
+		if (dir->n_subdirs == 0)
+			continue;
+		els = ld->els + ld->base[i];
+		for (j = 1; j < dir->n_subdirs; j++)
+			if (cmp_paths(els[j - 1], els[j]) >= 0)
+				return ERR_IO;
+
+		dir->subdirs_by_path = avl_build(els, dir->n_subdirs, fs->nodes);
+		if (dir->subdirs_by_path == NULL)
+			return ERR_NO_MEMORY;
+		if (dir->n_subdirs >= INDEX_THRESHOLD)
+			build_index(fs, dir);
+	}
+
+	return OK;
+}
+
+/*
+ * LOAD VALUES: Gives every directory its value
+ *    and builds the AVL of the holders of every
+ *    value straight from the order they were
+ *    loaded in, which is the order they're
+ *    printed in.
+ * - ERR_IO: A value is held by no directory.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int load_values(struct FS* fs, struct Loader* ld) {
+	struct Value* val;
+	int i, v, start, n = ld->h->n_dirs, n_vals = ld->h->n_values;
+
+	for (v = 0; v < n_vals; v++)
+		ld->ends[v] = 0;
+	for (i = 0; i < n; i++)
+		if ((v = ld->recs[i].value) != SNAP_NONE)
+			ld->ends[v]++;
+	for (start = 0, v = 0; v < n_vals; v++) {
+		if (ld->ends[v] == 0)
+			return ERR_IO;
+		start += ld->ends[v];
+		ld->ends[v] = start - ld->ends[v];
+	}
+
+	/* Each value's count became its start, and then its end */
+	for (i = 0; i < n; i++) {
+		if ((v = ld->recs[i].value) == SNAP_NONE)
+			continue;
+		ld->dirs[i]->value = ld->value_of[v];
+		ld->els[ld->ends[v]++] = ld->dirs[i];
+	}
+
+	for (start = 0, v = 0; v < n_vals; start = ld->ends[v++]) {
+		val = ld->value_of[v];
+		val->holders = avl_build(ld->els + start, ld->ends[v] - start, fs->nodes);
+		if (val->holders == NULL)
+			return ERR_NO_MEMORY;
+	}
+
+	return OK;
+}
+
+/*
+ * LOAD SNAPSHOT: Builds the filesystem from a
+ *    mapped snapshot in a few passes over its
+ *    arrays, the filesystem must be empty.
+ * - ERR_IO: The snapshot is broken.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int load_snapshot(struct FS* fs, struct Loader* ld) {
+	int status;
+
+	fs->next_id = ld->h->next_id;
+	if (ld->h->n_dirs == 0)
+		return OK;
+
+	if (!init_pools(fs))
+		return ERR_NO_MEMORY;
+	if ((status = load_strs(fs, ld)) != OK ||
+	    (status = load_dirs(fs, ld)) != OK ||
+	    (status = load_subdirs(fs, ld)) != OK)
+		return status;
+	return load_values(fs, ld);
+}
+
+/*
+ * DIRECTORY LIST PUSH: Adds a directory to the
+ *    end of a list. Returns 0 if it fails to
+ *    allocate memory.
+ */
+int dl_push(struct DirList* l, struct Directory* dir) {
+	struct Directory** dirs;
+	size_t cap = l->cap > 0 ? l->cap * 2 : 64;
+
+	if (l->len == l->cap) {
+		dirs = realloc(l->dirs, cap * sizeof(struct Directory*));
+		if (dirs == NULL)
+			return 0;
+		l->dirs = dirs;
+		l->cap = cap;
+	}
+	l->dirs[l->len++] = dir;
+	return 1;
+}
+
+/*
+ * VALUE AT: Returns the value a directory held
+ *    in the snapshot of the given epoch, or NULL.
+ */
+struct Value* value_at(struct Directory* dir, int s) {
+	struct Version* v;
+
+	if (dir->since <= s)
+		return dir->value;
+	for (v = dir->history; v != NULL && v->since > s; v = v->next)
+		;
+	return v != NULL && s < v->until ? v->value : NULL;
+}
+
+/*
+ * KEEP VERSION: Keeps the value of a directory
+ *    about to change as an older version, if a
+ *    snapshot sees it. Returns 0 if it fails to
+ *    allocate memory.
+ */
+int keep_version(struct FS* fs, struct Directory* dir) {
+	struct Version* v;
+
+	if (dir->value == NULL || fs->newest < dir->since)
+		return 1;
+	if (dir->history == NULL && !dl_push(&fs->hist, dir))
+		return 0;
+	v = pool_alloc(fs->versions);
+	if (v == NULL)
+		return 0;
+
+	v->value = dir->value;
+	v->since = dir->since;
+	v->until = fs->epoch;
+	v->next = dir->history;
+	dir->history = v;
+	dir->value->refs++;
+	return 1;
+}
+
+/*
+ * NEEDED: Returns true if a snapshot not yet
+ *    released has an epoch from the first given
+ *    one up to the second, not included.
+ */
+int needed(struct FS* fs, int from, int to) {
+	struct Snapshot* snap = fs->snaps;
+
+	while (snap != NULL && snap->epoch >= to)
+		snap = snap->next;
+	return snap != NULL && snap->epoch >= from;
+}
+
+/*
+ * BURY: Marks a removed directory and the
+ *    subdirectories still there as removed in
+ *    the current epoch. Their values leave the
+ *    lookup table once no directory holds them,
+ *    but stay with them for the snapshots.
+ */
+void bury(struct FS* fs, struct Directory* top) {
+	struct Directory* dir = top;
+	struct Directory* sub;
+	struct Value* val;
+
+	while (dir != NULL) {
+		dir->died = fs->epoch;
+		if ((val = dir->value) != NULL) {
+			val->refs++;
+			if (unhold_value(fs, dir) != NULL)
+				gone_push(fs, val);
+			dir->value = val;
+		}
+
+		sub = live(dir->first);
+		while (sub == NULL && dir != top) {
+			sub = live(dir->next);
+			dir = dir->p;
+		}
+		dir = sub;
+	}
+
+	drop_gone(fs);
+}
+
+/*
+ * PRUNE: Frees the older versions no snapshot
+ *    sees anymore, directories left without any
+ *    leave the list.
+ */
+void prune(struct FS* fs) {
+	struct DirList* l = &fs->hist;
+	struct Version **v, *old;
+	size_t i, n = 0;
+
+	for (i = 0; i < l->len; i++) {
+		for (v = &l->dirs[i]->history; *v != NULL;) {
+			if (needed(fs, (*v)->since, (*v)->until)) {
+				v = &(*v)->next;
+				continue;
+			}
+			old = *v;
+			*v = old->next;
+			unpin_value(fs, old->value);
+			pool_free(fs->versions, old);
+		}
+		if (l->dirs[i]->history != NULL)
+			l->dirs[n++] = l->dirs[i];
+	}
+	l->len = n;
+}
+
+/*
+ * RECLAIM: Frees the removed directories no
+ *    snapshot sees anymore. They're taken in the
+ *    order they were removed in, so those removed
+ *    from a subtree removed later go first.
+ */
+void reclaim(struct FS* fs) {
+	struct DirList* l = &fs->graves;
+	struct Directory* dir;
+	size_t i, n = 0;
+
+	for (i = 0; i < l->len; i++) {
+		dir = l->dirs[i];
+		if (needed(fs, dir->born, dir->died)) {
+			l->dirs[n++] = dir;
+			continue;
+		}
+		if (dir->p != NULL)
+			unlink_sibling(dir);
+		remove_directory(fs, dir);
+	}
+	l->len = n;
+}
+
+/*
+ * FORGET SNAPSHOTS: Drops every snapshot without
+ *    freeing what they kept, for when it is all
+ *    about to be released at once.
+ */
+void forget_snapshots(struct FS* fs) {
+	struct Snapshot* snap;
+
+	while ((snap = fs->snaps) != NULL) {
+		fs->snaps = snap->next;
+		free(snap);
+	}
+	fs->newest = -1;
+	fs->graves.len = fs->hist.len = 0;
+}
+
+/*
+ * FIND SNAPSHOT: Returns the snapshot with the
+ *    given handle, or NULL.
+ */
+struct Snapshot* find_snapshot(struct FS* fs, int id) {
+	struct Snapshot* snap = fs->snaps;
+
+	while (snap != NULL && snap->epoch != id)
+		snap = snap->next;
+	return snap;
+}
+
+/*
+ * FIND VERSION: Follows the given path through
+ *    the directories the snapshot of the given
+ *    epoch sees and returns the directory if
+ *    found. The subdirectories only find the one
+ *    holding a name now, a removed one is looked
+ *    for among the siblings.
+ */
+struct Directory* find_version(struct FS* fs, struct Directory* dir,
+                                                  char* path, int s) {
+	struct Directory* sub;
+	struct Name* name;
+	char* rel_path;
+
+	if (dir == NULL)
+		return NULL;
+
+	while ((rel_path = next_name(&path)) != NULL) {
+		name = ht_find(fs->names, rel_path, name_str);
+		if (name == NULL)
+			return NULL;
+
+		sub = find_subdir(dir, name);
+		if (sub == NULL || visible(sub, s) != sub) {
+			for (sub = visible(dir->first, s); sub != NULL &&
+			     sub->path != name; sub = visible(sub->next, s))
+				;
+		}
+		if (sub == NULL)
+			return NULL;
+		dir = sub;
+	}
+
+	return dir;
+}
+
+/*
+ * NEXT VERSION: Returns the directory printed
+ *    after the given one in the snapshot of the
+ *    given epoch, or NULL if there is none. The
+ *    buffer, holding the path of the given
+ *    directory, gets the path of the next one.
+ */
+struct Directory* next_version(struct PathBuf* pb, struct Directory* dir,
+                                                                 int s) {
+	struct Directory* sub = visible(dir->first, s);
+
+	while (sub == NULL && dir->p != NULL) {
+		sub = visible(dir->next, s);
+		pb_pop(pb, dir);
+		dir = dir->p;
+	}
+	if (sub != NULL && !pb_push(pb, sub))
+		return NULL;
+	return sub;
+}
+
+/*
+ * PRINT VERSION: Prints the full path and value
+ *    a directory had in the snapshot of the given
+ *    epoch, if it had one.
+ */
+void print_version(struct PathBuf* pb, struct Directory* dir, int s) {
+	struct Value* val = value_at(dir, s);
+
+	if (val != NULL) {
+		print_dir_full_path(pb, dir);
+		out_chr(' ');
+		out_mem(val->str, val->len);
+		out_chr('\n');
+	}
+}
+
+/*
+ * FILESYSTEM INIT: Creates a new filesystem.
+ */
+struct FS* fs_init() {
+	struct FS* fs = malloc(sizeof(struct FS));
+	if (fs == NULL)
+		return NULL;
+	fs->root = NULL;
+	fs->lookup = NULL;
+	if (pthread_rwlock_init(&fs->lock, NULL) != 0) {
+		free(fs);
+		return NULL;
+	}
+	fs->next_id = 0;
+	fs->gone.vals = NULL;
+	fs->gone.len = fs->gone.cap = 0;
+	fs->dirs = fs->nodes = fs->versions = NULL;
+	fs->strs = NULL;
+	fs->indexes = NULL;
+	fs->names = NULL;
+	fs->epoch = 0;
+	fs->newest = -1;
+	fs->snaps = NULL;
+	fs->graves.dirs = fs->hist.dirs = NULL;
+	fs->graves.len = fs->graves.cap = 0;
+	fs->hist.len = fs->hist.cap = 0;
+	new_gen(fs);
+	count_fs(1);
+	return fs;
+}
+
+/*
+ * SET PATH: Sets value for a given path.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int set_path(struct FS* fs, char* path, char* value) {
+	struct Directory* dir;
+	struct Value* val;
+
+	if (fs->root == NULL && !init_root(fs))
+		return ERR_NO_MEMORY;
+
+	dir = resolve_path(fs, path, 1);
+	if (dir == NULL)
+		return ERR_NO_MEMORY;
+
+	val = intern_value(fs, value);
+	if (val == NULL)
+		return ERR_NO_MEMORY;
+
+	if (dir->value != val) {
+		if (!keep_version(fs, dir))
+			return ERR_NO_MEMORY;
+		if (dir->value != NULL)
+			drop_value(fs, dir);
+		if (!hold_value(fs, dir, val))
+			return ERR_NO_MEMORY;
+		dir->since = fs->epoch;
+	}
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM SET
+ */
+int fs_set(struct FS* fs, char* path, char* value) {
+	int status;
+
+	pthread_rwlock_wrlock(&fs->lock);
+	status = set_path(fs, path, value);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * FIND VALUE: Print the value in a given
+ *    path.
+ * - ERR_NOT_FOUND: The directory does not exist.
+ * - ERR_NO_DATA: The path has no value.
+ */
+int find_value(struct FS* fs, char* path) {
+	struct Directory* dir = resolve_path(fs, path, 0);
+
+	if (dir == NULL)
+		return ERR_NOT_FOUND;
+	else if (dir->value == NULL)
+		return ERR_NO_DATA;
+
+	out_mem(dir->value->str, dir->value->len);
+	out_chr('\n');
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM FIND
+ */
+int fs_find(struct FS* fs, char* path) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = find_value(fs, path);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * LIST SUBDIRS: Print relative path of up to
+ *    count immediate subdirectories of a given
+ *    path in alphabetical order, starting at the
+ *    first one not before start. All of them are
+ *    printed if there is no start and count is
+ *    negative.
+ * - ERR_NOT_FOUND: The directory does not exist.
+ */
+int list_subdirs(struct FS* fs, char* path, char* start, int count) {
+	struct Directory* dir = resolve_path(fs, path, 0);
+	struct AVLIter it;
+
+	if (dir == NULL)
+		return ERR_NOT_FOUND;
+
+	avl_seek(&it, dir->subdirs_by_path, start, search_str);
+	for (; count != 0 && (dir = avl_next(&it)) != NULL; count--)
+		print_dir_relative_path(dir, NULL);
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM LIST
+ */
+int fs_list(struct FS* fs, char* path, char* start, int count) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = list_subdirs(fs, path, start, count);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * LIST PREFIX: Print relative path of the
+ *    immediate subdirectories of a given path
+ *    whose relative path starts with prefix, in
+ *    alphabetical order. They all follow the
+ *    first one not before prefix.
+ * - ERR_NOT_FOUND: The directory does not exist.
+ */
+int list_prefix(struct FS* fs, char* path, char* prefix) {
+	struct Directory* dir = resolve_path(fs, path, 0);
+	struct AVLIter it;
+	size_t len = strlen(prefix);
+
+	if (dir == NULL)
+		return ERR_NOT_FOUND;
+
+	avl_seek(&it, dir->subdirs_by_path, prefix, search_str);
+	while ((dir = avl_next(&it)) != NULL && dir->path->len >= len
+	       && memcmp(dir->path->str, prefix, len) == 0)
+		print_dir_relative_path(dir, NULL);
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM PREFIX
+ */
+int fs_prefix(struct FS* fs, char* path, char* prefix) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = list_prefix(fs, path, prefix);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * LIST RANGE: Print relative path of the
+ *    immediate subdirectories of a given path
+ *    whose relative path is between from and to,
+ *    in alphabetical order.
+ * - ERR_NOT_FOUND: The directory does not exist.
+ */
+int list_range(struct FS* fs, char* path, char* from, char* to) {
+	struct Directory* dir = resolve_path(fs, path, 0);
+	struct AVLIter it;
+
+	if (dir == NULL)
+		return ERR_NOT_FOUND;
+
+	avl_seek(&it, dir->subdirs_by_path, from, search_str);
+	while ((dir = avl_next(&it)) != NULL && search_str(to, dir) >= 0)
+		print_dir_relative_path(dir, NULL);
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM RANGE
+ */
+int fs_range(struct FS* fs, char* path, char* from, char* to) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = list_range(fs, path, from, to);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * COUNT SUBDIRS: Print the number of
+ *    directories below a given path.
+ * - ERR_NOT_FOUND: The directory does not exist.
+ */
+int count_subdirs(struct FS* fs, char* path) {
+	struct Directory* dir = resolve_path(fs, path, 0);
+
+	if (dir == NULL)
+		return ERR_NOT_FOUND;
+
+	out_num(dir->size - 1);
+	out_chr('\n');
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM COUNT
+ */
+int fs_count(struct FS* fs, char* path) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = count_subdirs(fs, path);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * COUNT CHILDREN: Print the number of
+ *    immediate subdirectories of a given path
+ *    whose relative path is between from and to,
+ *    or of all of them if there are no bounds.
+ * - ERR_NOT_FOUND: The directory does not exist.
+ */
+int count_children(struct FS* fs, char* path, char* from, char* to) {
+	struct Directory* dir = resolve_path(fs, path, 0);
+	struct AVL* subdirs;
+	int n;
+
+	if (dir == NULL)
+		return ERR_NOT_FOUND;
+
+	subdirs = dir->subdirs_by_path;
+	if (from == NULL || to == NULL) {
+		n = avl_size(subdirs);
+	} else {
+		n = avl_rank(subdirs, to, search_str) - avl_rank(subdirs, from, search_str);
+		if (avl_find(subdirs, to, search_str) != NULL)
+			n++;
+		if (n < 0)
+			n = 0;
+	}
+
+	out_num(n);
+	out_chr('\n');
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM CHILDREN
+ */
+int fs_children(struct FS* fs, char* path, char* from, char* to) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = count_children(fs, path, from, to);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * FIND NTH: Print the relative path of the
+ *    k-th immediate subdirectory of a given path
+ *    in alphabetical order, counting from 1.
+ * - ERR_NOT_FOUND: The directory or the
+ *    subdirectory does not exist.
+ */
+int find_nth(struct FS* fs, char* path, int k) {
+	struct Directory* dir = resolve_path(fs, path, 0);
+
+	if (dir == NULL || k < 1)
+		return ERR_NOT_FOUND;
+
+	dir = avl_nth(dir->subdirs_by_path, k - 1);
+	if (dir == NULL)
+		return ERR_NOT_FOUND;
+
+	print_dir_relative_path(dir, NULL);
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM NTH
+ */
+int fs_nth(struct FS* fs, char* path, int k) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = find_nth(fs, path, k);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * SEARCH VALUE: Print full path of the most
+ *    directory with the given value.
+ * - ERR_NOT_FOUND: The value was not found.
+ */
+int search_value(struct FS* fs, char* v) {
+	struct Value* val = ht_find(fs->lookup, v, value_str);
+	struct PathBuf* pb = thread_pb();
+	struct Directory* dir;
+
+	if (val == NULL)
+		return ERR_NOT_FOUND;
+
+	dir = avl_min(val->holders);
+
+	if (pb == NULL || !pb_build(pb, dir))
+		return ERR_NO_MEMORY;
+	print_dir_full_path(pb, dir);
+	out_chr('\n');
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM SEARCH
+ */
+int fs_search(struct FS* fs, char* v) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = search_value(fs, v);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * LOCATE VALUE: Stores a copy of the full path
+ *    search would print for the given value, to
+ *    be freed by the caller.
+ * - ERR_NOT_FOUND: The value was not found.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int locate_value(struct FS* fs, char* v, char** path) {
+	struct Value* val = ht_find(fs->lookup, v, value_str);
+	struct PathBuf* pb = thread_pb();
+	struct Directory* dir;
+	char* s;
+
+	if (val == NULL)
+		return ERR_NOT_FOUND;
+
+	dir = avl_min(val->holders);
+
+	/* The root's path is printed apart, see print_dir_full_path */
+	if (pb == NULL || !pb_build(pb, dir) ||
+	    (dir->p == NULL && !pb_push(pb, dir)))
+		return ERR_NO_MEMORY;
+
+	s = malloc(pb->len + 1);
+	if (s == NULL)
+		return ERR_NO_MEMORY;
+	memcpy(s, pb->s, pb->len);
+	s[pb->len] = '\0';
+	*path = s;
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM LOCATE
+ */
+int fs_locate(struct FS* fs, char* v, char** path) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = locate_value(fs, v, path);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * REMOVE PATH: Remove the directory with.
+ *    a given path.
+ * - ERR_NOT_FOUND: The directory does not exist.
+ */
+int remove_path(struct FS* fs, char* path) {
+	struct Directory* dir = find_directory(fs, fs->root, path);
+
+	if (dir == NULL)
+		return ERR_NOT_FOUND; /* Not found */
+	new_gen(fs);
+
+	/* Without snapshots removing the root releases everything */
+	if (dir == fs->root && fs->snaps == NULL) {
+		fs->root = NULL;
+		if (fs->lookup != NULL)
+			ht_destroy(fs->lookup);
+		fs->lookup = NULL;
+		release_memory(fs);
+		return OK;
+	}
+
+	/* Directories a snapshot sees are kept for it */
+	if (fs->newest >= dir->born && !dl_push(&fs->graves, dir))
+		return ERR_NO_MEMORY;
+
+	if (dir == fs->root) {
+		fs->root = NULL;
+	} else if (fs->snaps == NULL &&
+	           (fs->root->size - dir->size) * REBUILD_RATIO <= dir->size &&
+	           rebuild_without(fs, dir)) {
+		/* Removing almost everything copies what is kept */
+		return OK;
+	} else {
+		detach_directory(fs, dir);
+		order_cut(&dir->open, &dir->close);
+	}
+
+	if (fs->newest >= dir->born) {
+		bury(fs, dir);
+	} else {
+		if (dir->p != NULL)
+			unlink_sibling(dir);
+		remove_directory(fs, dir);
+	}
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM REMOVE
+ */
+int fs_remove(struct FS* fs, char* path) {
+	int status;
+
+	pthread_rwlock_wrlock(&fs->lock);
+	status = remove_path(fs, path);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * WITHIN: Returns true if a directory is the
+ *    given top one or one of its subdirectories.
+ */
+int within(struct Directory* top, struct Directory* dir) {
+	return top->open.label <= dir->open.label &&
+	       dir->close.label <= top->close.label;
+}
+
+/*
+ * PRINT PATH: Print the full path of up to
+ *    count directories of a given path's subtree
+ *    by creation order, starting at the start
+ *    path, or at the given one if there is none.
+ *    Every directory is printed if there is no
+ *    path and count is negative.
+ * - ERR_NOT_FOUND: The directory does not exist
+ *    or the start isn't in its subtree.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int print_path(struct FS* fs, char* path, char* start, int count) {
+	struct Directory* top = fs->root;
+	struct Directory* dir;
+	struct PathBuf* pb;
+
+	if (path != NULL && (top = resolve_path(fs, path, 0)) == NULL)
+		return ERR_NOT_FOUND;
+	if (top == NULL)
+		return OK;
+	if (start != NULL &&
+	    ((dir = resolve_path(fs, start, 0)) == NULL || !within(top, dir)))
+		return ERR_NOT_FOUND;
+	if (start == NULL)
+		dir = top;
+	if ((pb = thread_pb()) == NULL)
+		return ERR_NO_MEMORY;
+
+	pb->oom = 0;
+	if (pb_build(pb, dir))
+		print_from(pb, top, dir, count);
+	return pb->oom ? ERR_NO_MEMORY : OK;
+}
+
+/*
+ * FILESYSTEM PRINT
+ */
+int fs_print(struct FS* fs, char* path, char* start, int count) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = print_path(fs, path, start, count);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * TAKE SNAPSHOT: Takes a snapshot of every
+ *    directory and prints its handle. Nothing is
+ *    copied, the changes made after it keep what
+ *    it sees until it is released.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int take_snapshot(struct FS* fs) {
+	struct Snapshot* snap = malloc(sizeof(struct Snapshot));
+	if (snap == NULL)
+		return ERR_NO_MEMORY;
+
+	snap->epoch = fs->newest = fs->epoch++;
+	snap->root = fs->root;
+	snap->next = fs->snaps;
+	fs->snaps = snap;
+
+	out_num(snap->epoch);
+	out_chr('\n');
+
+	return OK;
+}
+
+/*
+ * FILESYSTEM SNAPSHOT
+ */
+int fs_snapshot(struct FS* fs) {
+	int status;
+
+	pthread_rwlock_wrlock(&fs->lock);
+	status = take_snapshot(fs);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * PRINT SNAPSHOT: Print the full path
+ *    and value of every directory of a snapshot
+ *    by creation order, starting at a given path
+ *    if there is one.
+ * - ERR_NOT_FOUND: The snapshot or the directory
+ *    does not exist.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int print_snapshot(struct FS* fs, int id, char* path) {
+	struct Snapshot* snap = find_snapshot(fs, id);
+	struct Directory* dir;
+	struct PathBuf* pb;
+
+	if (snap == NULL)
+		return ERR_NOT_FOUND;
+	dir = snap->root;
+	if (path != NULL && (dir = find_version(fs, dir, path, id)) == NULL)
+		return ERR_NOT_FOUND;
+	if (dir == NULL)
+		return OK;
+	if ((pb = thread_pb()) == NULL)
+		return ERR_NO_MEMORY;
+
+	pb->oom = 0;
+	if (pb_build(pb, dir)) {
+		for (; dir != NULL; dir = next_version(pb, dir, id))
+			print_version(pb, dir, id);
+	}
+	return pb->oom ? ERR_NO_MEMORY : OK;
+}
+
+/*
+ * FILESYSTEM SNAPSHOT PRINT
+ */
+int fs_sprint(struct FS* fs, int id, char* path) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = print_snapshot(fs, id, path);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * SEARCH SNAPSHOT: Print full path of
+ *    the first directory by creation order with
+ *    the given value in a snapshot.
+ * - ERR_NOT_FOUND: The snapshot or the value was
+ *    not found.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int search_snapshot(struct FS* fs, int id, char* v) {
+	struct Snapshot* snap = find_snapshot(fs, id);
+	struct PathBuf* pb = thread_pb();
+	struct Directory* dir;
+	struct Value* val;
+
+	if (snap == NULL || snap->root == NULL)
+		return ERR_NOT_FOUND;
+	if (pb == NULL)
+		return ERR_NO_MEMORY;
+
+	/* Old values aren't in the lookup table, the tree is walked */
+	pb->oom = 0;
+	dir = snap->root;
+	if (pb_build(pb, dir)) {
+		for (; dir != NULL; dir = next_version(pb, dir, id)) {
+			val = value_at(dir, id);
+			if (val != NULL && strcmp(val->str, v) == 0) {
+				print_dir_full_path(pb, dir);
+				out_chr('\n');
+				return OK;
+			}
+		}
+	}
+	return pb->oom ? ERR_NO_MEMORY : ERR_NOT_FOUND;
+}
+
+/*
+ * FILESYSTEM SNAPSHOT SEARCH
+ */
+int fs_ssearch(struct FS* fs, int id, char* v) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = search_snapshot(fs, id, v);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * RELEASE SNAPSHOT: Releases a snapshot, the
+ *    directories and values only it kept are
+ *    freed.
+ * - ERR_NOT_FOUND: The snapshot does not exist.
+ */
+int release_snapshot(struct FS* fs, int id) {
+	struct Snapshot** s = &fs->snaps;
+	struct Snapshot* snap;
+
+	while (*s != NULL && (*s)->epoch != id)
+		s = &(*s)->next;
+	if ((snap = *s) == NULL)
+		return ERR_NOT_FOUND;
+
+	*s = snap->next;
+	free(snap);
+	fs->newest = fs->snaps != NULL ? fs->snaps->epoch : -1;
+
+	prune(fs);
+	reclaim(fs);
+	return OK;
+}
+
+/*
+ * FILESYSTEM RELEASE
+ */
+int fs_release(struct FS* fs, int id) {
+	int status;
+
+	pthread_rwlock_wrlock(&fs->lock);
+	status = release_snapshot(fs, id);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * SAVE FILE: Writes every directory into a
+ *    snapshot file stamped with the given log
+ *    generation, replacing it once complete.
+ * - ERR_IO: The file couldn't be written.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int save_file(struct FS* fs, char* file, unsigned long gen) {
+	size_t n = (fs->root != NULL ? fs->root->size : 0) + 1;
+	struct Directory** dirs = malloc(n * sizeof(struct Directory*));
+	struct SnapDir* recs = malloc(n * sizeof(struct SnapDir));
+	struct Name** names = malloc(n * sizeof(struct Name*));
+	struct Value** vals = malloc(n * sizeof(struct Value*));
+	int status = ERR_NO_MEMORY;
+
+	if (dirs != NULL && recs != NULL && names != NULL && vals != NULL)
+		status = save_snapshot(fs, file, gen, dirs, recs, names, vals);
+
+	free(dirs);
+	free(recs);
+	free(names);
+	free(vals);
+	return status;
+}
+
+/*
+ * FILESYSTEM SAVE
+ */
+int fs_save(struct FS* fs, char* file) {
+	return fs_save_gen(fs, file, 0);
+}
+
+/*
+ * FILESYSTEM SAVE GENERATION: Saves the
+ *    filesystem as the snapshot a log replays on,
+ *    stamped with the generation of the log that
+ *    starts after it.
+ */
+int fs_save_gen(struct FS* fs, char* file, unsigned long gen) {
+	int status;
+
+	pthread_rwlock_rdlock(&fs->lock);
+	status = save_file(fs, file, gen);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * LOAD FROM: Replaces every directory with those
+ *    of a snapshot whose arrays the loader has
+ *    found, built in a copy that only takes the
+ *    filesystem's place if it succeeds.
+ * - ERR_IO: The snapshot is broken.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int load_from(struct FS* fs, struct Loader* ld) {
+	struct FS copy;
+	int status = ERR_NO_MEMORY;
+
+	ld->name_of = malloc((ld->h->n_names + 1) * sizeof(struct Name*));
+	ld->value_of = malloc((ld->h->n_values + 1) * sizeof(struct Value*));
+	ld->dirs = malloc((ld->h->n_dirs + 1) * sizeof(struct Directory*));
+	ld->base = malloc((ld->h->n_dirs + 1) * sizeof(int));
+	ld->els = malloc((ld->h->n_dirs + 1) * sizeof(void*));
+	ld->ends = malloc((ld->h->n_values + 1) * sizeof(int));
+
+	empty_copy(&copy, fs);
+	if (ld->name_of != NULL && ld->value_of != NULL && ld->dirs != NULL &&
+	    ld->base != NULL && ld->els != NULL && ld->ends != NULL)
+		status = load_snapshot(&copy, ld);
+
+	/* Loading the directories moved next_id past the one of the header */
+	if (status == OK) {
+		forget_snapshots(fs);
+		replace_with(fs, &copy);
+		fs->next_id = ld->h->next_id;
+	} else {
+		discard_copy(&copy);
+	}
+
+	free(ld->name_of);
+	free(ld->value_of);
+	free(ld->dirs);
+	free(ld->base);
+	free(ld->els);
+	free(ld->ends);
+	return status;
+}
+
+/*
+ * LOAD FILE: Replaces every directory with
+ *    those of a snapshot file and stores its log
+ *    generation. The filesystem is left as it
+ *    was if it fails.
+ * - ERR_IO: The file couldn't be read or isn't a
+ *    valid snapshot.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int load_file(struct FS* fs, char* file, unsigned long* gen) {
+	struct Loader ld;
+	size_t sz;
+	void* map = snap_map(file, &sz);
+	int status = ERR_IO;
+
+	if (map == NULL)
+		return ERR_IO;
+	if (open_loader(&ld, map, sz))
+		status = load_from(fs, &ld);
+	if (status == OK)
+		*gen = ld.h->log_gen;
+	snap_unmap(map, sz);
+	return status;
+}
+
+/*
+ * FILESYSTEM LOAD
+ */
+int fs_load(struct FS* fs, char* file) {
+	unsigned long gen;
+
+	return fs_load_gen(fs, file, &gen);
+}
+
+/*
+ * FILESYSTEM LOAD GENERATION: Loads a snapshot
+ *    and stores the generation it was stamped
+ *    with, 0 if it wasn't saved for a log.
+ */
+int fs_load_gen(struct FS* fs, char* file, unsigned long* gen) {
+	int status;
+
+	pthread_rwlock_wrlock(&fs->lock);
+	status = load_file(fs, file, gen);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/************************************************
+ * BULK PAIR: Line of a bulk file.
+ * - key: Path, rewritten as its relative paths
+ *    each followed by a NUL, so keys are ordered
+ *    like their paths by memcmp.
+ *
+ * - len: Length of the key.
+ *
+ * - value: Value set.
+ *
+ * - line: Position among the pairs of the file.
+ *************************************************/
+struct BulkPair {
+	char* key;
+	size_t len;
+	char* value;
+	int line;
+};
+
+/************************************************
+ * BULK DIRECTORY: Directory of a bulk file.
+ * - name: Relative path, in the file's buffer.
+ *
+ * - value: Last value set, or NULL.
+ *
+ * - parent: Position of the parent, the root
+ *    being the first directory.
+ *
+ * - first: First pair to go through it, which
+ *    is the one that would have created it.
+ *
+ * - n_subdirs: Number of subdirectories.
+ *
+ * - pos: Position of its record.
+ *
+ * - rec: Its record, filled as it's found.
+ *************************************************/
+struct BulkDir {
+	char *name, *value;
+	int parent, first, n_subdirs, pos;
+	struct SnapDir rec;
+};
+
+/*
+ * READ PAIRS: Splits the lines of a bulk file,
+ *    which must be NUL terminated, and keeps
+ *    those with both a path and a value, read
+ *    like the arguments of a set. Returns how
+ *    many were kept.
+ */
+int read_pairs(char* buf, size_t sz, struct BulkPair* pairs) {
+	char *line, *nl, *path, *value, *end = buf + sz;
+	int n = 0;
+
+	for (line = buf; line < end; line = nl + 1) {
+		if ((nl = memchr(line, '\n', end - line)) == NULL)
+			nl = end;
+		*nl = '\0';
+		path = in_token(&line);
+		value = in_rest(&line);
+		if (path == NULL || value == NULL)
+			continue;
+		pairs[n].key = path;
+		pairs[n].value = value;
+		pairs[n].line = n;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * NORMALIZE PAIR: Rewrites the path of a pair as
+ *    its key, returns its amount of relative
+ *    paths.
+ */
+int normalize_pair(struct BulkPair* pair) {
+	char *path = pair->key, *out = pair->key, *name;
+	size_t len;
+	int depth = 0;
+
+	while ((name = next_name(&path)) != NULL) {
+		len = strlen(name) + 1;
+		memmove(out, name, len);
+		out += len;
+		depth++;
+	}
+	pair->len = out - pair->key;
+	return depth;
+}
+
+/*
+ * COMPARE PAIRS: Orders pairs by path, then by
+ *    line, used to sort them.
+ */
+int cmp_pairs(const void* p1, const void* p2) {
+	const struct BulkPair *a = p1, *b = p2;
+	int c = memcmp(a->key, b->key, a->len < b->len ? a->len : b->len);
+
+	if (c != 0)
+		return c;
+	if (a->len != b->len)
+		return a->len < b->len ? -1 : 1;
+	return a->line - b->line;
+}
+
+/*
+ * BULK NAME, BULK VALUE: Given a directory of a
+ *    bulk file return its relative path, or its
+ *    value.
+ */
+char* bulk_name(void* dir) {
+	return ((struct BulkDir*)dir)->name;
+}
+
+char* bulk_value(void* dir) {
+	return ((struct BulkDir*)dir)->value;
+}
+
+/*
+ * BULK TREE: Finds the directories of the sorted
+ *    pairs, which come in the order of their
+ *    paths, so a directory is found right after
+ *    its previous sibling's subtree and its rank
+ *    is the amount of siblings found before it.
+ *    The stack holds the directories of the last
+ *    path. Returns the amount of directories.
+ */
+int bulk_tree(struct BulkPair* pairs, int n, struct BulkDir* dirs,
+                                           int* stack, char* root) {
+	struct BulkDir* dir;
+	char *s, *end;
+	int i, depth, top = 0, n_dirs = 1;
+
+	dirs[0].name = root;
+	dirs[0].value = NULL;
+	dirs[0].parent = SNAP_NONE;
+	dirs[0].first = INT_MAX;
+	dirs[0].n_subdirs = 0;
+	dirs[0].rec.rank = 0;
+	stack[0] = 0;
+
+	for (i = 0; i < n; i++) {
+		s = pairs[i].key;
+		end = s + pairs[i].len;
+		for (depth = 0; depth < top && s < end &&
+		     strcmp(dirs[stack[depth + 1]].name, s) == 0; depth++)
+			s += strlen(s) + 1;
+
+		for (top = depth; s < end; s += strlen(s) + 1) {
+			dir = &dirs[n_dirs];
+			dir->name = s;
+			dir->value = NULL;
+			dir->parent = stack[top];
+			dir->first = INT_MAX;
+			dir->n_subdirs = 0;
+			dir->rec.rank = dirs[stack[top]].n_subdirs++;
+			stack[++top] = n_dirs++;
+		}
+
+		for (depth = 0; depth <= top; depth++)
+			if (dirs[stack[depth]].first > pairs[i].line)
+				dirs[stack[depth]].first = pairs[i].line;
+		dirs[stack[top]].value = pairs[i].value;
+	}
+	return n_dirs;
+}
+
+/*
+ * BULK STRINGS: Gives every directory the index
+ *    of its relative path, or of its value, among
+ *    the distinct ones, which are added to the
+ *    table as they're first found. A table of the
+ *    directories holding each is sized for all of
+ *    them at once. Returns how many there are, or
+ *    -1 if it fails to allocate memory.
+ */
+int bulk_strs(struct BulkDir* dirs, int n_dirs, int values, char* buf,
+                                                struct SnapStr* table) {
+	char* (*key)(void*) = values ? bulk_value : bulk_name;
+	struct HashTable* seen = ht_new(n_dirs);
+	struct BulkDir *dir, *found;
+	unsigned int hash;
+	size_t len;
+	char* str;
+	int d, k = 0, *index;
+
+	for (d = 0; seen != NULL && d < n_dirs; d++) {
+		dir = &dirs[d];
+		index = values ? &dir->rec.value : &dir->rec.name;
+		if ((str = key(dir)) == NULL) {
+			*index = SNAP_NONE;
+			continue;
+		}
+
+		len = strlen(str);
+		hash = ht_hash_len(str, len);
+		found = ht_find_hashed(seen, str, hash, key);
+		if (found != NULL) {
+			*index = values ? found->rec.value : found->rec.name;
+			continue;
+		}
+		table[k].off = str - buf;
+		table[k].len = len;
+		*index = k++;
+		seen = ht_insert_hashed(seen, dir, hash);
+	}
+
+	if (seen == NULL)
+		return -1;
+	ht_destroy(seen);
+	return k;
+}
+
+/*
+ * BULK RECORDS: Gives every directory the id the
+ *    sets would have, ordering them by their
+ *    first pair, a pair creating its directories
+ *    from the top down, and fills the records in
+ *    the order they're printed in, siblings being
+ *    printed by id. Returns 0 if it fails to
+ *    allocate memory.
+ */
+int bulk_recs(struct BulkDir* dirs, int n_dirs, int n, int next_id,
+                               int depth, struct SnapDir* recs) {
+	int* count = malloc((n + 1) * sizeof(int));
+	int* by_id = malloc(n_dirs * sizeof(int));
+	int* base = malloc(n_dirs * sizeof(int));
+	int* kids = malloc(n_dirs * sizeof(int));
+	int* stack = malloc((depth + 1) * sizeof(int));
+	int* next = malloc((depth + 1) * sizeof(int));
+	int i, d, top, k, ok = count != NULL && by_id != NULL &&
+	       base != NULL && kids != NULL && stack != NULL && next != NULL;
+
+	/* The directories of a pair are found from the top down too */
+	for (i = 0; ok && i <= n; i++)
+		count[i] = 0;
+	for (d = 0; ok && d < n_dirs; d++)
+		count[dirs[d].first + 1]++;
+	for (i = 0; ok && i < n; i++)
+		count[i + 1] += count[i];
+	for (d = 0; ok && d < n_dirs; d++) {
+		by_id[count[dirs[d].first]++] = d;
+		dirs[d].rec.id = next_id + count[dirs[d].first] - 1;
+	}
+
+	for (i = d = 0; ok && d < n_dirs; d++) {
+		base[d] = i;
+		i += dirs[d].n_subdirs;
+	}
+	for (k = 1; ok && k < n_dirs; k++)
+		kids[base[dirs[by_id[k]].parent]++] = by_id[k];
+	for (d = 0; ok && d < n_dirs; d++)
+		base[d] -= dirs[d].n_subdirs;
+
+	if (ok) {
+		recs[0] = dirs[0].rec;
+		recs[0].parent = SNAP_NONE;
+		dirs[0].pos = k = 0;
+		stack[0] = next[0] = top = 0;
+	}
+	while (ok && top >= 0) {
+		d = stack[top];
+		if (next[top] == dirs[d].n_subdirs) {
+			top--;
+			continue;
+		}
+		i = kids[base[d] + next[top]++];
+		dirs[i].pos = ++k;
+		recs[k] = dirs[i].rec;
+		recs[k].parent = dirs[d].pos;
+		stack[++top] = i;
+		next[top] = 0;
+	}
+
+	free(count);
+	free(by_id);
+	free(base);
+	free(kids);
+	free(stack);
+	free(next);
+	return ok;
+}
+
+/*
+ * BULK BUILD: Builds an empty filesystem from
+ *    the pairs of a bulk file in one go. Sorted
+ *    by path, in parallel, the pairs give every
+ *    directory's subdirectories in order, so the
+ *    filesystem is loaded from the snapshot they
+ *    make, with its AVLs built balanced and its
+ *    tables sized once.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int bulk_build(struct FS* fs, struct BulkPair* pairs, int n, char* buf,
+                                                            size_t sz) {
+	struct SnapHeader h;
+	struct Loader ld;
+	struct BulkDir* dirs;
+	int* stack;
+	size_t total = 1;
+	int i, d, depth = 0, n_dirs, n_names, n_vals, status = ERR_NO_MEMORY;
+
+	if (n == 0)
+		return OK;
+	for (i = 0; i < n; i++) {
+		d = normalize_pair(&pairs[i]);
+		total += d;
+		if (d > depth)
+			depth = d;
+	}
+	psort(pairs, n, sizeof(struct BulkPair), cmp_pairs);
+
+	dirs = malloc(total * sizeof(struct BulkDir));
+	stack = malloc((depth + 1) * sizeof(int));
+	ld.names = malloc(total * sizeof(struct SnapStr));
+	ld.values = malloc(n * sizeof(struct SnapStr));
+	ld.recs = malloc(total * sizeof(struct SnapDir));
+
+	if (dirs != NULL && stack != NULL &&
+	    ld.names != NULL && ld.values != NULL && ld.recs != NULL) {
+		/* The root's name goes after the file, in the same buffer */
+		n_dirs = bulk_tree(pairs, n, dirs, stack, buf + sz + 1);
+		n_names = bulk_strs(dirs, n_dirs, 0, buf, ld.names);
+		n_vals = bulk_strs(dirs, n_dirs, 1, buf, ld.values);
+		h.n_dirs = n_dirs;
+		h.n_names = n_names;
+		h.n_values = n_vals;
+		h.next_id = fs->next_id + n_dirs;
+		h.strs_sz = sz + 1 + sizeof(FS_ROOT);
+		ld.h = &h;
+		ld.strs = buf;
+		if (n_names >= 0 && n_vals >= 0 &&
+		    bulk_recs(dirs, n_dirs, n, fs->next_id, depth, ld.recs))
+			status = load_from(fs, &ld);
+	}
+
+	free(dirs);
+	free(stack);
+	free(ld.names);
+	free(ld.values);
+	free(ld.recs);
+	return status;
+}
+
+/*
+ * BULK FILE: Sets the path and value of every
+ *    line of a file, in order, the same as a set
+ *    for each line. An empty filesystem with no
+ *    snapshots is built in one go, otherwise the
+ *    sets are made one by one.
+ * - ERR_IO: The file couldn't be read.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int bulk_file(struct FS* fs, char* file) {
+	struct BulkPair* pairs;
+	size_t sz, lines = 1;
+	void* map = snap_map(file, &sz);
+	char *buf, *s;
+	int i, n, status = OK;
+
+	if (map == NULL)
+		return ERR_IO;
+	buf = malloc(sz + 1 + sizeof(FS_ROOT));
+	if (buf == NULL) {
+		snap_unmap(map, sz);
+		return ERR_NO_MEMORY;
+	}
+	memcpy(buf, map, sz);
+	snap_unmap(map, sz);
+	buf[sz] = '\0';
+	memcpy(buf + sz + 1, FS_ROOT, sizeof(FS_ROOT));
+
+	for (s = buf; (s = memchr(s, '\n', buf + sz - s)) != NULL; s++)
+		lines++;
+	pairs = malloc(lines * sizeof(struct BulkPair));
+	if (pairs == NULL) {
+		free(buf);
+		return ERR_NO_MEMORY;
+	}
+	n = read_pairs(buf, sz, pairs);
+
+	if (fs->root == NULL && fs->snaps == NULL)
+		status = bulk_build(fs, pairs, n, buf, sz);
+	else
+		for (i = 0; i < n && status == OK; i++)
+			status = set_path(fs, pairs[i].key, pairs[i].value);
+
+	free(pairs);
+	free(buf);
+	return status;
+}
+
+/*
+ * FILESYSTEM BULK
+ */
+int fs_bulk(struct FS* fs, char* file) {
+	int status;
+
+	pthread_rwlock_wrlock(&fs->lock);
+	status = bulk_file(fs, file);
+	pthread_rwlock_unlock(&fs->lock);
+	return status;
+}
+
+/*
+ * PRINT STATISTIC: Prints a named number and its
+ *    unit.
+ */
+void print_stat(char* name, unsigned long n, char* unit) {
+	out_str(name);
+	out_chr(' ');
+	out_num(n);
+	out_line(unit);
+}
+
+/*
+ * PRINT LATENCY: Prints the average of a sampled
+ *    latency, or a dash if it has no samples.
+ */
+void print_latency(char* name, unsigned long ns, unsigned long samples) {
+	if (samples > 0) {
+		print_stat(name, ns / samples, " ns");
+	} else {
+		out_str(name);
+		out_line(" -");
+	}
+}
+
+/*
+ * FILESYSTEM STATISTICS: Prints the hits, misses,
+ *    hit rate, sampled latencies and evictions of
+ *    the calling thread's path cache.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int fs_stats(struct FS* fs) {
+	struct Cache* c = thread_cache();
+	struct CacheStats* st;
+	unsigned long total;
+
+	/* The cache is the thread's, every filesystem it uses shares it */
+	(void)fs;
+
+	if (c == NULL)
+		return ERR_NO_MEMORY;
+	st = cache_stats(c);
+	total = st->hits + st->misses;
+
+	print_stat("hits", st->hits, "");
+	print_stat("misses", st->misses, "");
+	print_stat("hit rate", total > 0 ? st->hits * 100 / total : 0, "%");
+	print_latency("hit latency", st->hit_ns, st->hit_samples);
+	print_latency("miss latency", st->miss_ns, st->miss_samples);
+	print_stat("evictions", st->evictions, "");
 	return OK;
 }
+
+/*
+ * FILESYSTEM DESTROY: Removes every directory and
+ *    frees the filesystem.
+ */
+void fs_destroy(struct FS* fs) {
+	struct PathBuf* pb;
+	struct Cache* c;
+	struct Finger* f;
+
+	forget_snapshots(fs);
+	remove_path(fs, FS_ROOT);
+
+	/* A root removed under a snapshot leaves the rest behind */
+	if (fs->lookup != NULL)
+		ht_destroy(fs->lookup);
+	if (fs->dirs != NULL)
+		release_memory(fs);
+	/* The buffers of the thread destroying the last filesystem aren't
+	 * needed anymore, before that the others still use them */
+	if (count_fs(-1) == 0) {
+		pb = thread_pb();
+		if (pb != NULL) {
+			pthread_setspecific(pb_key, NULL);
+			free_pb(pb);
+		}
+		c = thread_cache();
+		if (c != NULL) {
+			pthread_setspecific(cache_key, NULL);
+			cache_destroy(c);
+		}
+		f = thread_finger();
+		if (f != NULL) {
+			pthread_setspecific(finger_key, NULL);
+			free_finger(f);
+		}
+	}
+	pthread_rwlock_destroy(&fs->lock);
+	free(fs->gone.vals);
+	free(fs->graves.dirs);
+	free(fs->hist.dirs);
+	free(fs);
+}
@@ -11,6 +11,7 @@
 #define ERR_NOT_FOUND 1
 #define ERR_NO_DATA 2
 #define ERR_NO_MEMORY 3
+#define ERR_IO 4
 
 struct FS;
 
@@ -18,6 +19,23 @@ struct FS* fs_init();
 int fs_set(struct FS* fs, char* path, char* value);
 int fs_remove(struct FS* fs, char* path);
 int fs_find(struct FS* fs, char* path);
-int fs_list(struct FS* fs, char* path);
+int fs_list(struct FS* fs, char* path, char* start, int count);
+int fs_prefix(struct FS* fs, char* path, char* prefix);
+int fs_range(struct FS* fs, char* path, char* from, char* to);
+int fs_count(struct FS* fs, char* path);
+int fs_children(struct FS* fs, char* path, char* from, char* to);
+int fs_nth(struct FS* fs, char* path, int k);
 int fs_search(struct FS* fs, char* value);
-int fs_print(struct FS* fs);
+int fs_locate(struct FS* fs, char* value, char** path);
+int fs_print(struct FS* fs, char* path, char* start, int count);
+int fs_save(struct FS* fs, char* file);
+int fs_save_gen(struct FS* fs, char* file, unsigned long gen);
+int fs_load(struct FS* fs, char* file);
+int fs_load_gen(struct FS* fs, char* file, unsigned long* gen);
+int fs_bulk(struct FS* fs, char* file);
+int fs_stats(struct FS* fs);
+int fs_snapshot(struct FS* fs);
+int fs_sprint(struct FS* fs, int id, char* path);
+int fs_ssearch(struct FS* fs, int id, char* value);
+int fs_release(struct FS* fs, int id);
+void fs_destroy(struct FS* fs);
@@ -6,79 +6,411 @@
 
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "hashtable.h"
 
-#define INITIAL_SZ 13
+#define INITIAL_SZ 32
+#define GROUP_SZ 16
+#define MIGRATE_SZ 32
+#define EMPTY 0x80
+
+#define PRIME1 0x9E3779B185EBCA87UL
+#define PRIME2 0xC2B2AE3D27D4EB4FUL
+#define PRIME3 0x165667B19E3779F9UL
+#define PRIME4 0x85EBCA77C2B2AE63UL
 
 /************************************************
- * HASHTABLE:
- * - table_sz: Current size of the table.
+ * SLOT:
+ * - hash: Hash of the element's key, kept so it
+ *    isn't computed again and most keys that
+ *    don't match are told apart without
+ *    comparing them.
+ *
+ * - el: The element.
+ *************************************************/
+struct Slot {
+	unsigned int hash;
+	void* el;
+};
+
+/************************************************
+ * TABLE:
+ * - sz: Size of the table, always a power of two.
+ *
+ * - mask: sz - 1, the low bits of a hash pick the
+ *    slot.
  *
  * - amt: Amount of elements in the table.
  *
- * - ht: Table of elements.
+ * - ctrl: Control byte of each slot, EMPTY or 7
+ *    bits of the element's hash. The first
+ *    GROUP_SZ - 1 bytes are repeated after the
+ *    end so a group can be loaded from any slot.
+ *
+ * - slots: Table of elements.
  *************************************************/
-struct HashTable {
-	int table_sz;
+struct Table {
+	int sz;
+	int mask;
 	int amt;
-	void** ht;
+	unsigned char* ctrl;
+	struct Slot* slots;
+};
+
+/************************************************
+ * HASHTABLE:
+ * - cur: Table new elements go into.
+ *
+ * - old: Table being resized from, its elements
+ *    are moved into cur a few at a time by the
+ *    operations that change the hashtable. Has no
+ *    slots when there is no resize going on.
+ *
+ * - moved: Next slot of old to be moved.
+ *
+ * - left: Slots of old still to be moved.
+ *************************************************/
+struct HashTable {
+	struct Table cur, old;
+	int moved, left;
 };
 
 /*
- * NEW TABLE: Creates a new hashtable.
+ * FREE TABLE: Frees the table's slots.
  */
-struct HashTable* new_table(int max) {
-	int i;
+void free_table(struct Table* t) {
+	free(t->ctrl);
+	free(t->slots);
+	t->ctrl = NULL;
+	t->slots = NULL;
+	t->sz = t->amt = 0;
+}
+
+/*
+ * INIT TABLE: Allocates a table with the given
+ *    size, which must be a power of two no
+ *    smaller than GROUP_SZ. Returns 0 if it fails
+ *    to allocate memory.
+ */
+int init_table(struct Table* t, int sz) {
+	t->sz = sz;
+	t->mask = sz - 1;
+	t->amt = 0;
+
+	t->ctrl = malloc(sz + GROUP_SZ - 1);
+	t->slots = malloc(sz * sizeof(struct Slot));
+
+	if (t->ctrl == NULL || t->slots == NULL) {
+		free_table(t);
+		return 0;
+	}
+
+	memset(t->ctrl, EMPTY, sz + GROUP_SZ - 1);
+	return 1;
+}
+
+/*
+ * NEW TABLE: Creates a new hashtable with the
+ *    given size.
+ */
+struct HashTable* new_table(int sz) {
 	struct HashTable* ht = malloc(sizeof(struct HashTable));
 
 	if (ht == NULL)
 		return NULL;
 
-	ht->table_sz = 2 * max;
-	ht->amt = 0;
-
-	ht->ht = malloc(ht->table_sz * sizeof(void*));
+	ht->old.ctrl = NULL;
+	ht->old.slots = NULL;
+	ht->old.sz = ht->old.amt = 0;
+	ht->moved = ht->left = 0;
 
-	if (ht->ht == NULL)
+	if (!init_table(&ht->cur, sz)) {
+		free(ht);
 		return NULL;
-
-	for (i = 0; i < ht->table_sz; i++)
-		ht->ht[i] = NULL;
+	}
 
 	return ht;
 }
 
 /*
- * HASH: Returns the sting's hash.
+ * ROTATE: Rotates a word left by r bits.
  */
-int hash(char* v, int M) {
-	unsigned int h, a = 31415, b = 27183;
+unsigned long rotate(unsigned long x, int r) {
+	return x << r | x >> (64 - r);
+}
 
-	for (h = 0; *v != '\0'; v++, a = a*b % (M-1))
-		h = (a*h + *v) % M;
+/*
+ * HASH WORD: Mixes a word of the key into the
+ *    hash.
+ */
+unsigned long hash_word(unsigned long h, unsigned long w) {
+	w = rotate(w * PRIME2, 31) * PRIME1;
+	return rotate(h ^ w, 27) * PRIME1 + PRIME4;
+}
+
+/*
+ * HASHTABLE HASH LENGTH: Returns the hash of the
+ *    given n bytes. The key is read 8 bytes at a
+ *    time and every bit of the result depends on
+ *    every bit of the key. The hash doesn't
+ *    depend on the size of the table so it can be
+ *    computed once and kept.
+ */
+unsigned int ht_hash_len(char* v, size_t n) {
+	unsigned long w, h = PRIME3 ^ (n * PRIME1);
+
+	for (; n >= sizeof(w); n -= sizeof(w), v += sizeof(w)) {
+		memcpy(&w, v, sizeof(w));
+		h = hash_word(h, w);
+	}
+	if (n > 0) {
+		w = 0;
+		memcpy(&w, v, n);
+		h = hash_word(h, w);
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
 	return h;
 }
 
 /*
- * EXPAND: Doubles the size of the table and
- *    reashes the elements.
+ * HASHTABLE HASH: Returns the string's hash.
+ */
+unsigned int ht_hash(char* v) {
+	return ht_hash_len(v, strlen(v));
+}
+
+/*
+ * FINGERPRINT: Returns the control byte of an
+ *    element with the given hash, taken from the
+ *    high bits since the low ones pick the slot.
+ */
+unsigned char fingerprint(unsigned int h) {
+	return h >> 25;
+}
+
+
+/*
+ * SET CONTROL: Sets the control byte of a slot
+ *    and of its copy.
+ */
+void set_ctrl(struct Table* t, int i, unsigned char c) {
+	t->ctrl[i] = c;
+	if (i < GROUP_SZ - 1)
+		t->ctrl[t->sz + i] = c;
+}
+
+/*
+ * MATCH GROUP: Returns a mask with a bit set for
+ *    each of the GROUP_SZ control bytes starting
+ *    at the given one that are equal to c.
  */
-struct HashTable* expand(struct HashTable* ht, char* (*k)(void*)) {
+unsigned int match_group(unsigned char* ctrl, unsigned char c) {
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((__m128i*)ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+	unsigned int i, mask = 0;
+
+	for (i = 0; i < GROUP_SZ; i++)
+		if (ctrl[i] == c)
+			mask |= 1u << i;
+	return mask;
+#endif
+}
+
+/*
+ * FIRST BIT: Returns the position of the lowest
+ *    bit set in a non zero mask.
+ */
+int first_bit(unsigned int mask) {
+#ifdef __GNUC__
+	return __builtin_ctz(mask);
+#else
 	int i;
-	struct HashTable* new_ht = new_table(ht->table_sz * 2);
 
-	if (new_ht == NULL)
-		return NULL;
+	for (i = 0; !(mask & 1); i++)
+		mask >>= 1;
+	return i;
+#endif
+}
+
+/*
+ * PROBE: Finds the slot holding an element with
+ *    the given hash and key. Returns -1 if there
+ *    is none. GROUP_SZ slots are checked at once,
+ *    only the slots with the same control byte
+ *    and hash are compared.
+ */
+int probe(struct Table* t, char* v, unsigned int h, char* (*k)(void*)) {
+	unsigned char fp = fingerprint(h);
+	unsigned int match, empty;
+	int i = h & t->mask, j;
+	char* key;
+
+#ifdef __GNUC__
+	/* Fetch the slots while the control bytes are matched */
+	__builtin_prefetch(&t->slots[i]);
+#endif
+
+	for (;;) {
+		match = match_group(t->ctrl + i, fp);
+		empty = match_group(t->ctrl + i, EMPTY);
+
+		/* The cluster ends at the first empty slot */
+		if (empty != 0)
+			match &= (empty & -empty) - 1;
+
+		while (match != 0) {
+			j = (i + first_bit(match)) & t->mask;
+			if (t->slots[j].hash == h) {
+				key = k(t->slots[j].el);
+				if (key == v || strcmp(v, key) == 0)
+					return j;
+			}
+			match &= match - 1;
+		}
+
+		if (empty != 0)
+			return -1;
+		i = (i + GROUP_SZ) & t->mask;
+	}
+}
+
+/*
+ * PLACE: Puts an element in the first empty
+ *    slot of its cluster.
+ */
+void place(struct Table* t, void* el, unsigned int h) {
+	int i = h & t->mask;
+	unsigned int empty;
+
+	while ((empty = match_group(t->ctrl + i, EMPTY)) == 0)
+		i = (i + GROUP_SZ) & t->mask;
+
+	i = (i + first_bit(empty)) & t->mask;
+	set_ctrl(t, i, fingerprint(h));
+	t->slots[i].hash = h;
+	t->slots[i].el = el;
+	t->amt++;
+}
+
+/*
+ * IN RANGE: Returns true if slot k is in the
+ *    cyclic range ]i, j].
+ */
+int in_range(int k, int i, int j) {
+	return i <= j ? i < k && k <= j : i < k || k <= j;
+}
+
+/*
+ * TAKE: Removes a given element from the table,
+ *    returns 0 if it isn't there. The elements
+ *    after it in its cluster are shifted back
+ *    into the hole so no tombstones are left.
+ */
+int take(struct Table* t, void* el, unsigned int h, int (*cmp)(void*, void*)) {
+	int i, j;
+
+	for (i = h & t->mask; ; i = (i + 1) & t->mask) {
+		if (t->ctrl[i] == EMPTY)
+			return 0;
+		/* Two elements with the same key might not be
+		 * the same so the given cmp function is used */
+		if (t->slots[i].hash == h && cmp(el, t->slots[i].el) == 0)
+			break;
+	}
+
+	set_ctrl(t, i, EMPTY);
+	--t->amt;
+
+	for (j = (i + 1) & t->mask; t->ctrl[j] != EMPTY; j = (j + 1) & t->mask) {
+		/* Elements that can't be found past the hole move into it */
+		if (!in_range(t->slots[j].hash & t->mask, i, j)) {
+			set_ctrl(t, i, t->ctrl[j]);
+			t->slots[i] = t->slots[j];
+			set_ctrl(t, j, EMPTY);
+			i = j;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * MIGRATE: Moves the elements in the next n slots
+ *    of the old table into the current one. It
+ *    only stops at an empty slot so every cluster
+ *    left in the old table is whole and its
+ *    elements can still be found there.
+ */
+void migrate(struct HashTable* ht, int n) {
+	struct Table* old = &ht->old;
+	int i;
 
-	for (i = 0; i < ht->table_sz; i++)
-		if (ht->ht[i] != NULL) {
-			new_ht = ht_insert(new_ht, ht->ht[i], k);
-			if (new_ht == NULL)
-				return NULL;
+	while (old->amt > 0 && (n > 0 || old->ctrl[ht->moved] != EMPTY)) {
+		i = ht->moved;
+		if (old->ctrl[i] != EMPTY) {
+			place(&ht->cur, old->slots[i].el, old->slots[i].hash);
+			set_ctrl(old, i, EMPTY);
+			old->amt--;
 		}
+		ht->moved = (i + 1) & old->mask;
+		n--;
+	}
 
-	ht_destroy(ht);
-	return new_ht;
+	if (old->amt == 0)
+		free_table(old);
+}
+
+/*
+ * RESIZE: Starts moving the elements into a new
+ *    table with the given size, finishing the
+ *    previous resize first. The elements are
+ *    moved by later operations a few slots at a
+ *    time so none of them stalls on the whole
+ *    table. Returns 0 if it fails to allocate
+ *    memory.
+ */
+int resize(struct HashTable* ht, int sz) {
+	struct Table t;
+	unsigned int empty;
+	int i;
+
+	if (ht->old.slots != NULL)
+		migrate(ht, ht->old.sz);
+	if (!init_table(&t, sz))
+		return 0;
+
+	ht->old = ht->cur;
+	ht->cur = t;
+
+	/* Moving starts at an empty slot, the start of a cluster */
+	for (i = 0; (empty = match_group(ht->old.ctrl + i, EMPTY)) == 0;)
+		i = (i + GROUP_SZ) & ht->old.mask;
+	ht->moved = (i + first_bit(empty)) & ht->old.mask;
+
+	if (ht->old.amt == 0)
+		free_table(&ht->old);
+	return 1;
+}
+
+/*
+ * HASHTABLE NEW: Creates an empty hashtable with
+ *    room for n elements before it has to grow.
+ */
+struct HashTable* ht_new(int n) {
+	int sz = INITIAL_SZ;
+
+	while (sz / 4 * 3 < n)
+		sz *= 2;
+	return new_table(sz);
 }
 
 /*
@@ -87,29 +419,50 @@ struct HashTable* expand(struct HashTable* ht, char* (*k)(void*)) {
  *    given key function.
  */
 struct HashTable* ht_insert(struct HashTable* ht, void* el, char* (*k)(void*)) {
-	int i;
+	return ht_insert_hashed(ht, el, ht_hash(k(el)));
+}
 
+/*
+ * HASHTABLE INSERT HASHED: Same as above, for
+ *    when the key's hash is already known. The
+ *    table doubles its size past 3/4 full.
+ */
+struct HashTable* ht_insert_hashed(struct HashTable* ht, void* el,
+                                                     unsigned int h) {
 	if (ht == NULL) {
 		ht = new_table(INITIAL_SZ);
 		if (ht == NULL)
 			return NULL;
 	}
 
-	i = hash(k(el), ht->table_sz);
+	if (ht->old.slots != NULL)
+		migrate(ht, MIGRATE_SZ);
 
-	while (ht->ht[i] != NULL)
-		i = (i + 1) % ht->table_sz;
-	ht->ht[i] = el;
+	place(&ht->cur, el, h);
 
-	if (++ht->amt * 2 > ht->table_sz) {
-		ht = expand(ht, k);
-		if (ht == NULL)
-			return NULL;
-	}
+	if ((ht->cur.amt + ht->old.amt) * 4 > ht->cur.sz * 3 &&
+	                                 !resize(ht, ht->cur.sz * 2))
+		return NULL;
 
 	return ht;
 }
 
+/*
+ * SEARCH TABLE: Returns the best of el and the
+ *    elements of the table with the given key.
+ */
+void* search_table(struct Table* t, char* v, unsigned int h, void* el,
+                        char* (*k)(void*), int (*better)(void*, void*)) {
+	int i;
+
+	for (i = h & t->mask; t->ctrl[i] != EMPTY; i = (i + 1) & t->mask)
+		if (t->slots[i].hash == h && strcmp(v, k(t->slots[i].el)) == 0 &&
+		                                       better(t->slots[i].el, el))
+			el = t->slots[i].el;
+
+	return el;
+}
+
 /*
  * HASHTABLE SEARCH: Returns the element with the
  *    given key, when there are multiple
@@ -118,55 +471,172 @@ struct HashTable* ht_insert(struct HashTable* ht, void* el, char* (*k)(void*)) {
  */
 void* ht_search(struct HashTable* ht, char* v, char* (*k)(void*),
                                      int (*better)(void*, void*)) {
-	int i = hash(v, ht->table_sz);
-	void* el = NULL;
+	unsigned int h = ht_hash(v);
+	void* el;
 
-	while (ht->ht[i] != NULL) {
-		if (strcmp(v, k(ht->ht[i])) == 0 && better(ht->ht[i], el))
-				el = ht->ht[i];
-		i = (i + 1) % ht->table_sz;
-	}
+	if (ht == NULL)
+		return NULL;
 
+	el = search_table(&ht->cur, v, h, NULL, k, better);
+	if (ht->old.slots != NULL)
+		el = search_table(&ht->old, v, h, el, k, better);
 	return el;
 }
 
+/*
+ * HASHTABLE FIND: Returns the first element found
+ *    with the given key, for tables where keys
+ *    are unique.
+ */
+void* ht_find(struct HashTable* ht, char* v, char* (*k)(void*)) {
+	return ht_find_hashed(ht, v, ht_hash(v), k);
+}
+
+/*
+ * HASHTABLE FIND HASHED: Same as above, for when
+ *    the key's hash is already known. Keys that
+ *    are the same string are found without
+ *    comparing them. Finding never moves
+ *    elements, so it doesn't change the table.
+ */
+void* ht_find_hashed(struct HashTable* ht, char* v, unsigned int h,
+                                               char* (*k)(void*)) {
+	int i;
+
+	if (ht == NULL)
+		return NULL;
+
+	i = probe(&ht->cur, v, h, k);
+	if (i >= 0)
+		return ht->cur.slots[i].el;
+	if (ht->old.slots == NULL)
+		return NULL;
+
+	i = probe(&ht->old, v, h, k);
+	return i < 0 ? NULL : ht->old.slots[i].el;
+}
+
 /*
  * HASHTABLE REMOVE: Removes a given element from
  *    the table.
  */
 struct HashTable* ht_remove(struct HashTable* ht, void* el, char* (*k)(void*),
                                                      int (*cmp)(void*, void*)) {
-	int i = hash(k(el), ht->table_sz);
+	return ht_remove_hashed(ht, el, ht_hash(k(el)), cmp);
+}
 
-	while (ht->ht[i] != NULL) {
-		/* Two elements with the same key might not be
-		 * the same so the given cmp function is used */
-		if (cmp(el, ht->ht[i]) == 0) {
-			ht->ht[i] = NULL;
-			--ht->amt;
-			break;
+/*
+ * HASHTABLE REMOVE HASHED: Same as above, for
+ *    when the key's hash is already known. The
+ *    table halves its size under 1/8 full.
+ */
+struct HashTable* ht_remove_hashed(struct HashTable* ht, void* el,
+                             unsigned int h, int (*cmp)(void*, void*)) {
+	if (ht->old.slots != NULL) {
+		migrate(ht, MIGRATE_SZ);
+		if (ht->old.slots != NULL && take(&ht->old, el, h, cmp)) {
+			if (ht->old.amt == 0)
+				free_table(&ht->old);
+			return ht;
 		}
-		i = (i + 1) % ht->table_sz;
 	}
 
-	i = (i + 1) % ht->table_sz;
+	take(&ht->cur, el, h, cmp);
+
+	/* Shrinking is skipped if it fails, the table still works */
+	if (ht->old.slots == NULL && ht->cur.sz > INITIAL_SZ &&
+	                              ht->cur.amt * 8 < ht->cur.sz)
+		resize(ht, ht->cur.sz / 2);
+
+	return ht;
+}
 
-	while (ht->ht[i] != NULL) {
-		void* aux = ht->ht[i];
-		ht->ht[i] = NULL;
-		--ht->amt;
-		ht = ht_insert(ht, aux, k);
-		/* No need the verify if the allocation was sucessful
-		 * since space in the table has just been freed. */
-		i = (i + 1) % ht->table_sz;
+/*
+ * REHASH: Puts every element of the table back
+ *    in the first empty slot of its cluster,
+ *    after some were emptied without shifting
+ *    the others. Elements are taken in order from
+ *    slot s, which was empty before, so each one
+ *    moves back to its own slot or before it and
+ *    the ones put back before stay reachable.
+ */
+void rehash(struct Table* t, int s) {
+	struct Slot slot;
+	int i, k;
+
+	for (k = 1; k < t->sz; k++) {
+		i = (s + k) & t->mask;
+		if (t->ctrl[i] != EMPTY) {
+			slot = t->slots[i];
+			set_ctrl(t, i, EMPTY);
+			t->amt--;
+			place(t, slot.el, slot.hash);
+		}
 	}
+}
+
+/*
+ * HASHTABLE FILTER: Removes every element for
+ *    which the given keep function returns 0,
+ *    the function may free them. The table is
+ *    rebuilt once with the kept elements instead
+ *    of removing them one at a time, and sized
+ *    for them when it can be allocated.
+ */
+struct HashTable* ht_filter(struct HashTable* ht, int (*keep)(void*, void*),
+                                                               void* extra) {
+	struct Table* t;
+	struct Table fit;
+	unsigned int empty;
+	int i, s, sz;
+
+	if (ht == NULL)
+		return NULL;
+
+	if (ht->old.slots != NULL)
+		migrate(ht, ht->old.sz);
+	t = &ht->cur;
+
+	for (s = 0; (empty = match_group(t->ctrl + s, EMPTY)) == 0;)
+		s = (s + GROUP_SZ) & t->mask;
+	s = (s + first_bit(empty)) & t->mask;
+
+	for (i = 0; i < t->sz; i++) {
+		if (t->ctrl[i] != EMPTY && !keep(t->slots[i].el, extra)) {
+			set_ctrl(t, i, EMPTY);
+			t->amt--;
+		}
+	}
+
+	for (sz = INITIAL_SZ; t->amt * 8 > sz * 3; sz *= 2)
+		;
+
+	if (sz < t->sz && init_table(&fit, sz)) {
+		for (i = 0; i < t->sz; i++)
+			if (t->ctrl[i] != EMPTY)
+				place(&fit, t->slots[i].el, t->slots[i].hash);
+		free_table(t);
+		*t = fit;
+	} else {
+		rehash(t, s);
+	}
+
 	return ht;
 }
 
+/*
+ * HASHTABLE SIZE: Returns the amount of elements
+ *    in the table.
+ */
+int ht_size(struct HashTable* ht) {
+	return ht == NULL ? 0 : ht->cur.amt + ht->old.amt;
+}
+
 /*
  * HASHTABLE DESTROY: Free the hashtable.
  */
 void ht_destroy(struct HashTable* ht) {
-	free(ht->ht);
+	free_table(&ht->cur);
+	free_table(&ht->old);
 	free(ht);
 }
@@ -4,11 +4,26 @@
  * Desc:	This header exposes the hashtable interface.
  */
 
+#include <stddef.h>
+
 struct HashTable;
 
+struct HashTable* ht_new(int n);
 struct HashTable* ht_insert(struct HashTable* ht, void* el, char* (*k)(void*));
+struct HashTable* ht_insert_hashed(struct HashTable* ht, void* el,
+                                                     unsigned int h);
 struct HashTable* ht_remove(struct HashTable* ht, void* el, char* (*k)(void*),
                                                      int (*cmp)(void*, void*));
+struct HashTable* ht_remove_hashed(struct HashTable* ht, void* el,
+                             unsigned int h, int (*cmp)(void*, void*));
 void* ht_search(struct HashTable* ht, char* v, char* (*k)(void*),
                                      int (*better)(void*, void*));
+void* ht_find(struct HashTable* ht, char* v, char* (*k)(void*));
+void* ht_find_hashed(struct HashTable* ht, char* v, unsigned int h,
+                                               char* (*k)(void*));
+struct HashTable* ht_filter(struct HashTable* ht, int (*keep)(void*, void*),
+                                                               void* extra);
+int ht_size(struct HashTable* ht);
+unsigned int ht_hash(char* v);
+unsigned int ht_hash_len(char* v, size_t n);
 void ht_destroy(struct HashTable* ht);
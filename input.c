@@ -0,0 +1,277 @@
+/*
+ * File:	input.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Input reader implementation, reads the commands in big
+ *    blocks and splits them in place.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+
+#define BLOCK_SZ 1048576
+
+/************************************************
+ * INPUT:
+ * - fd: File descriptor being read, -1 once the
+ *    whole input is in the buffer.
+ *
+ * - buf: Block with the input, either a heap
+ *    buffer or a private mapping of the file.
+ *
+ * - cap: Capacity of the buffer.
+ *
+ * - start: Offset of the first unread byte.
+ *
+ * - end: Offset past the last byte in the buffer.
+ *
+ * - scan: Offset up to which the buffer was
+ *    already searched for a line break.
+ *
+ * - mapped: Whether the buffer is a mapping.
+ *
+ * - unmapped: Offset up to which the blocks of
+ *    the mapping already read were given back.
+ *
+ * - err: IN_OK, or why the input stopped before
+ *    its end.
+ *************************************************/
+struct Input {
+	int fd;
+	char* buf;
+	size_t cap, start, end, scan, unmapped;
+	int mapped;
+	int err;
+};
+
+/*
+ * MAP FILE: Maps the whole file into memory, only
+ *    done when the file ends with a line break so
+ *    every line can be terminated in place.
+ */
+int map_file(struct Input* in) {
+	struct stat st;
+	char last;
+	void* map;
+
+	if (fstat(in->fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+		return 0;
+	if (pread(in->fd, &last, 1, st.st_size - 1) != 1 || last != '\n')
+		return 0;
+
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, in->fd, 0);
+	if (map == MAP_FAILED)
+		return 0;
+
+	close(in->fd);
+	in->fd = -1;
+	in->buf = map;
+	in->cap = in->end = st.st_size;
+	in->mapped = 1;
+	return 1;
+}
+
+/*
+ * INPUT OPEN: Opens the given file, or stdin when
+ *    no file is given.
+ */
+struct Input* in_open(char* file) {
+	struct Input* in = malloc(sizeof(struct Input));
+	if (in == NULL)
+		return NULL;
+
+	in->fd = STDIN_FILENO;
+	in->buf = NULL;
+	in->cap = in->start = in->end = in->scan = in->unmapped = 0;
+	in->mapped = 0;
+	in->err = IN_OK;
+
+	if (file != NULL) {
+		in->fd = open(file, O_RDONLY);
+		if (in->fd < 0) {
+			free(in);
+			return NULL;
+		}
+		if (map_file(in))
+			return in;
+	}
+
+	in->cap = BLOCK_SZ;
+	in->buf = malloc(in->cap);
+	if (in->buf == NULL) {
+		in_close(in);
+		return NULL;
+	}
+
+	return in;
+}
+
+/*
+ * REFILL: Moves the unread bytes to the front of
+ *    the buffer and reads the next block, growing
+ *    the buffer when a line doesn't fit in it.
+ *    Returns 0 if it fails to allocate memory or
+ *    to read, storing which in err.
+ */
+int refill(struct Input* in) {
+	ssize_t n;
+
+	if (in->start > 0) {
+		memmove(in->buf, in->buf + in->start, in->end - in->start);
+		in->end -= in->start;
+		in->scan -= in->start;
+		in->start = 0;
+	}
+
+	/* A byte is always kept free to terminate the last line */
+	if (in->end + 1 >= in->cap) {
+		char* buf = realloc(in->buf, in->cap * 2);
+		if (buf == NULL) {
+			in->err = IN_NO_MEMORY;
+			return 0;
+		}
+		in->buf = buf;
+		in->cap *= 2;
+	}
+
+	do
+		n = read(in->fd, in->buf + in->end, in->cap - in->end - 1);
+	while (n < 0 && errno == EINTR);
+
+	if (n < 0) {
+		in->err = IN_IO;
+		return 0;
+	} else if (n == 0) {
+		if (in->fd != STDIN_FILENO)
+			close(in->fd);
+		in->fd = -1;
+	} else {
+		in->end += n;
+	}
+
+	return 1;
+}
+
+/*
+ * INPUT LINE: Returns the next line of the input
+ *    without the line break, or NULL when there
+ *    are no more lines or the input failed, which
+ *    in_error tells apart. The line lives in the
+ *    reader's buffer until the next call.
+ */
+char* in_line(struct Input* in) {
+	char* line;
+	char* nl;
+
+	if (in->err != IN_OK)
+		return NULL;
+
+	/* Lines before the last one are never used again, so
+	 * the pages written while splitting them are given back */
+	while (in->mapped && in->start - in->unmapped >= BLOCK_SZ) {
+		munmap(in->buf + in->unmapped, BLOCK_SZ);
+		in->unmapped += BLOCK_SZ;
+	}
+
+	for (;;) {
+		nl = memchr(in->buf + in->scan, '\n', in->end - in->scan);
+		if (nl != NULL) {
+			*nl = '\0';
+			line = in->buf + in->start;
+			in->start = in->scan = nl - in->buf + 1;
+			return line;
+		}
+		in->scan = in->end;
+
+		if (in->fd < 0) {
+			if (in->start == in->end)
+				return NULL;
+			/* Last line had no line break */
+			in->buf[in->end] = '\0';
+			line = in->buf + in->start;
+			in->start = in->end;
+			return line;
+		}
+
+		if (!refill(in))
+			return NULL;
+	}
+}
+
+/*
+ * INPUT TOKEN: Splits the next whitespace
+ *    delimited token from the line in place,
+ *    returns NULL if there is none.
+ */
+char* in_token(char** line) {
+	char* tok = *line;
+
+	while (isspace((unsigned char)*tok))
+		tok++;
+	if (*tok == '\0') {
+		*line = tok;
+		return NULL;
+	}
+
+	for (*line = tok; **line != '\0' && !isspace((unsigned char)**line);)
+		(*line)++;
+	if (**line != '\0')
+		*(*line)++ = '\0';
+
+	return tok;
+}
+
+/*
+ * INPUT REST: Returns what's left of the line
+ *    after the separating spaces, or NULL if
+ *    nothing is left.
+ */
+char* in_rest(char** line) {
+	char* rest = *line;
+
+	while (*rest == ' ')
+		rest++;
+	*line = rest + strlen(rest);
+
+	return *rest == '\0' ? NULL : rest;
+}
+
+/*
+ * INPUT PENDING: Returns true if the next line
+ *    can be returned without blocking on a read.
+ */
+int in_pending(struct Input* in) {
+	return in->fd < 0 || memchr(in->buf + in->scan, '\n', in->end - in->scan);
+}
+
+/*
+ * INPUT ERROR: Returns why the input stopped,
+ *    IN_OK if it reached its end.
+ * - IN_NO_MEMORY: The reader failed to allocate
+ *    memory.
+ * - IN_IO: The input couldn't be read.
+ */
+int in_error(struct Input* in) {
+	return in->err;
+}
+
+/*
+ * INPUT CLOSE: Releases the reader.
+ */
+void in_close(struct Input* in) {
+	if (in->mapped)
+		munmap(in->buf + in->unmapped, in->cap - in->unmapped);
+	else
+		free(in->buf);
+	if (in->fd > STDIN_FILENO)
+		close(in->fd);
+	free(in);
+}
@@ -0,0 +1,19 @@
+/*
+ * File:	input.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the input reader interface.
+ */
+
+#define IN_OK 0
+#define IN_NO_MEMORY 1
+#define IN_IO 2
+
+struct Input;
+
+struct Input* in_open(char* file);
+char* in_line(struct Input* in);
+char* in_token(char** line);
+char* in_rest(char** line);
+int in_pending(struct Input* in);
+int in_error(struct Input* in);
+void in_close(struct Input* in);
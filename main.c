@@ -4,77 +4,271 @@
  * Desc:	Entry point of the program, handles input.
  */
 
-#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include "fs.h"
+#include "wal.h"
+#include "input.h"
+#include "output.h"
 
-#define BUFF_SZ 65536
 #define KEEP_GOING 0
 #define STOP -1
 #define EXIT_OK 0
+#define EXIT_ERR 1
+#define LOAD_FLAG "-l"
+#define WAL_FLAG "-w"
+#define GROUP_FLAG "-g"
+#define INTERVAL_FLAG "-i"
+#define WAL_GROUP 128
+#define WAL_INTERVAL 10
 
 #define HELP_HELP "help: Imprime os comandos disponíveis.\n"
 #define HELP_QUIT "quit: Termina o programa.\n"
 #define HELP_SET "set: Adiciona ou modifica o valor a armazenar.\n"
-#define HELP_PRINT "print: Imprime todos os caminhos e valores.\n"
+#define HELP_PRINT "print: Imprime todos os caminhos e valores, ou os <n> de um sub-caminho a partir de <inicio>.\n"
 #define HELP_FIND "find: Imprime o valor armazenado.\n"
-#define HELP_LIST "list: Lista todos os componentes imediatos de um sub-caminho.\n"
+#define HELP_LIST "list: Lista todos os componentes imediatos de um sub-caminho, ou os <n> a partir de <inicio>.\n"
 #define HELP_SEARCH "search: Procura o caminho dado um valor.\n"
-#define HELP_DELETE "delete: Apaga um caminho e todos os subcaminhos."
+#define HELP_DELETE "delete: Apaga um caminho e todos os subcaminhos.\n"
+#define HELP_PREFIX "prefix: Lista os componentes imediatos de um sub-caminho que começam por <p>.\n"
+#define HELP_RANGE "range: Lista os componentes imediatos de um sub-caminho entre <a> e <b>.\n"
+#define HELP_COUNT "count: Imprime o número de subcaminhos de um caminho.\n"
+#define HELP_CHILDREN "children: Imprime o número de componentes imediatos de um sub-caminho, ou só dos entre <a> e <b>.\n"
+#define HELP_NTH "nth: Imprime o <k>-ésimo componente imediato de um sub-caminho.\n"
+#define HELP_SAVE "save: Guarda todos os caminhos e valores num ficheiro.\n"
+#define HELP_LOAD "load: Substitui todos os caminhos e valores pelos de um ficheiro.\n"
+#define HELP_SNAPSHOT "snapshot: Fixa o estado atual e imprime o seu identificador.\n"
+#define HELP_SPRINT "sprint: Imprime os caminhos e valores de um estado fixado, ou a partir de um caminho.\n"
+#define HELP_SSEARCH "ssearch: Procura o caminho dado um valor num estado fixado.\n"
+#define HELP_RELEASE "release: Liberta um estado fixado.\n"
+#define HELP_BULK "bulk: Adiciona os caminhos e valores de um ficheiro, um par por linha.\n"
+#define HELP_STATS "stats: Imprime as estatísticas da cache de caminhos."
 
 #define ERR_MSG_NOT_FOUND "not found"
 #define ERR_MSG_NO_DATA "no data"
 #define ERR_MSG_NO_MEMORY "no memory"
+#define ERR_MSG_IO "io error"
+
+/*
+ * READ COUNT: Reads an optional count argument,
+ *    which is -1 when it's missing. Returns 0 if
+ *    it isn't a number.
+ */
+int read_count(char* arg, int* count) {
+	char* end;
+	long n;
+
+	*count = -1;
+	if (arg == NULL)
+		return 1;
+
+	n = strtol(arg, &end, 10);
+	if (*end != '\0' || end == arg || n < 0 || n > INT_MAX)
+		return 0;
+	*count = n;
+	return 1;
+}
+
+/*
+ * LOGGED: Appends a change to the log, if there
+ *    is one, before it is made. Returns 0 if it
+ *    fails.
+ */
+int logged(struct Wal* wal, int op, char* path, char* value) {
+	return wal == NULL || wal_append(wal, op, path, value);
+}
+
+/*
+ * SAVE BASE: Saves the filesystem as the log's
+ *    snapshot, stamped with the given log
+ *    generation. Returns 0 if it fails.
+ */
+int save_base(char* file, unsigned long gen, void* fs_store) {
+	return fs_save_gen(fs_store, file, gen) == OK;
+}
+
+/*
+ * CHECKPOINTED: Makes the state after a change
+ *    that succeeded the log's snapshot, if there
+ *    is a log, for changes it has no records for.
+ */
+int checkpointed(struct Wal* wal, struct FS* fs_store, int status) {
+	if (status != OK || wal == NULL)
+		return status;
+	return wal_checkpoint(wal, save_base, fs_store) ? OK : ERR_IO;
+}
+
+/*
+ * REPLAY: Makes a change read from the log, with
+ *    no output. Returns 0 if it fails to allocate
+ *    memory or to read a file.
+ */
+int replay(int op, char* path, char* value, void* fs_store) {
+	int status = OK;
+
+	if (op == WAL_SET && value != NULL)
+		status = fs_set(fs_store, path, value);
+	else if (op == WAL_DELETE)
+		status = fs_remove(fs_store, path);
+
+	return status != ERR_NO_MEMORY && status != ERR_IO;
+}
 
 /*
  * COMMAND HANDLING FUNCTIONS: The following
- *    functions read the arguments from stdin and
- *    call the relevant function of the filesystem
- *    interface.
+ *    functions split the arguments from the rest
+ *    of the command line and call the relevant
+ *    function of the filesystem interface.
  */
-int set(struct FS* fs_store) {
-	char path[BUFF_SZ], data[BUFF_SZ];
-	scanf("%s%*[ ]%[^\n]", path, data);
+int set(struct FS* fs_store, struct Wal* wal, char* args) {
+	char* path = in_token(&args);
+	char* data = in_rest(&args);
+	if (path == NULL || data == NULL)
+		return OK;
+	if (!logged(wal, WAL_SET, path, data))
+		return ERR_IO;
 	return fs_set(fs_store, path, data);
 }
 
-int print(struct FS* fs_store) {
-	return fs_print(fs_store);
+int print(struct FS* fs_store, char* args) {
+	char* path = in_token(&args);
+	int count;
+	if (!read_count(in_token(&args), &count))
+		return OK;
+	return fs_print(fs_store, path, in_token(&args), count);
+}
+
+int find(struct FS* fs_store, char* args) {
+	char* path = in_token(&args);
+	return fs_find(fs_store, path != NULL ? path : FS_ROOT);
+}
+
+int list(struct FS* fs_store, char* args) {
+	char* path = in_token(&args);
+	char* start = in_token(&args);
+	int count;
+	if (!read_count(in_token(&args), &count))
+		return OK;
+	return fs_list(fs_store, path != NULL ? path : FS_ROOT, start, count);
 }
 
-int find(struct FS* fs_store) {
-	char path[BUFF_SZ];
-	scanf("%s", path);
-	return fs_find(fs_store, path);
+int prefix(struct FS* fs_store, char* args) {
+	char* path = in_token(&args);
+	char* p = in_token(&args);
+	if (p == NULL)
+		return OK;
+	return fs_prefix(fs_store, path, p);
 }
 
-int list(struct FS* fs_store) {
-	char path[BUFF_SZ] = FS_ROOT;
-	scanf("%*[ ]%s", path);
-	return fs_list(fs_store, path);
+int range(struct FS* fs_store, char* args) {
+	char* path = in_token(&args);
+	char* from = in_token(&args);
+	char* to = in_token(&args);
+	if (to == NULL)
+		return OK;
+	return fs_range(fs_store, path, from, to);
 }
 
-int delete(struct FS* fs_store) {
-	char path[BUFF_SZ] = FS_ROOT;
-	scanf("%*[ ]%s", path);
+int delete(struct FS* fs_store, struct Wal* wal, char* args) {
+	char* path = in_token(&args);
+	if (path == NULL)
+		path = FS_ROOT;
+	if (!logged(wal, WAL_DELETE, path, NULL))
+		return ERR_IO;
 	return fs_remove(fs_store, path);
 }
 
-int search(struct FS* fs_store) {
-	char data[BUFF_SZ];
-	scanf("%*[ ]%[^\n]", data);
+int count(struct FS* fs_store, char* args) {
+	char* path = in_token(&args);
+	return fs_count(fs_store, path != NULL ? path : FS_ROOT);
+}
+
+int children(struct FS* fs_store, char* args) {
+	char* path = in_token(&args);
+	char* from = in_token(&args);
+	char* to = in_token(&args);
+	return fs_children(fs_store, path != NULL ? path : FS_ROOT, from, to);
+}
+
+int nth(struct FS* fs_store, char* args) {
+	char* path = in_token(&args);
+	int k;
+	if (path == NULL || !read_count(in_token(&args), &k) || k < 0)
+		return OK;
+	return fs_nth(fs_store, path, k);
+}
+
+int search(struct FS* fs_store, char* args) {
+	char* data = in_rest(&args);
+	if (data == NULL)
+		return OK;
 	return fs_search(fs_store, data);
 }
 
+int save(struct FS* fs_store, struct Wal* wal, char* args) {
+	char* file = in_rest(&args);
+	if (file == NULL)
+		return OK;
+	if (wal != NULL && wal_is_base(wal, file))
+		return checkpointed(wal, fs_store, OK);
+	return fs_save(fs_store, file);
+}
+
+int load(struct FS* fs_store, struct Wal* wal, char* args) {
+	char* file = in_rest(&args);
+	if (file == NULL)
+		return OK;
+	return checkpointed(wal, fs_store, fs_load(fs_store, file));
+}
+
+int bulk(struct FS* fs_store, struct Wal* wal, char* args) {
+	char* file = in_rest(&args);
+	if (file == NULL)
+		return OK;
+	return checkpointed(wal, fs_store, fs_bulk(fs_store, file));
+}
+
+int snapshot(struct FS* fs_store) {
+	return fs_snapshot(fs_store);
+}
+
+int sprint(struct FS* fs_store, char* args) {
+	int id;
+	if (!read_count(in_token(&args), &id) || id < 0)
+		return OK;
+	return fs_sprint(fs_store, id, in_token(&args));
+}
+
+int ssearch(struct FS* fs_store, char* args) {
+	int id;
+	char* data;
+	if (!read_count(in_token(&args), &id) || id < 0)
+		return OK;
+	data = in_rest(&args);
+	if (data == NULL)
+		return OK;
+	return fs_ssearch(fs_store, id, data);
+}
+
+int release(struct FS* fs_store, char* args) {
+	int id;
+	if (!read_count(in_token(&args), &id) || id < 0)
+		return OK;
+	return fs_release(fs_store, id);
+}
+
+int stats(struct FS* fs_store) {
+	return fs_stats(fs_store);
+}
+
 int quit(struct FS* fs_store) {
-	fs_remove(fs_store, FS_ROOT);
-	free(fs_store);
+	fs_destroy(fs_store);
 	return STOP;
 }
 
 int help() {
-	puts(
+	out_str(
 		HELP_HELP
 		HELP_QUIT
 		HELP_SET
@@ -84,6 +278,23 @@ int help() {
 		HELP_SEARCH
 		HELP_DELETE
 	);
+	out_str(
+		HELP_PREFIX
+		HELP_RANGE
+		HELP_COUNT
+		HELP_CHILDREN
+		HELP_NTH
+		HELP_SAVE
+	);
+	out_line(
+		HELP_LOAD
+		HELP_SNAPSHOT
+		HELP_SPRINT
+		HELP_SSEARCH
+		HELP_RELEASE
+		HELP_BULK
+		HELP_STATS
+	);
 	return 0;
 }
 
@@ -91,26 +302,65 @@ int help() {
 /*
  * SELECTION FUNCTION: Reads the command from
  *    stdin and picks the relevant command
- *    handling funcion.
+ *    handling funcion. The end of the input
+ *    is handled as a quit command, a failure to
+ *    read it stops the program with its error.
  */
-int select(struct FS* fs_store) {
-	char cmd[BUFF_SZ];
-	scanf("%s", cmd);
+int select(struct FS* fs_store, struct Wal* wal, struct Input* in) {
+	char* args = in_line(in);
+	char* cmd;
+
+	if (args == NULL && in_error(in) == IN_NO_MEMORY)
+		return ERR_NO_MEMORY;
+	if (args == NULL && in_error(in) == IN_IO) {
+		out_line(ERR_MSG_IO);
+		return quit(fs_store);
+	}
+	if (args == NULL)
+		return quit(fs_store);
+	if ((cmd = in_token(&args)) == NULL)
+		return OK;
 
 	if (strcmp(cmd, "help") == 0)
 		return help();
 	else if (strcmp(cmd, "set") == 0)
-		return set(fs_store);
+		return set(fs_store, wal, args);
 	else if (strcmp(cmd, "print") == 0)
-		return print(fs_store);
+		return print(fs_store, args);
 	else if (strcmp(cmd, "find") == 0)
-		return find(fs_store);
+		return find(fs_store, args);
 	else if (strcmp(cmd, "list") == 0)
-		return list(fs_store);
+		return list(fs_store, args);
+	else if (strcmp(cmd, "prefix") == 0)
+		return prefix(fs_store, args);
+	else if (strcmp(cmd, "range") == 0)
+		return range(fs_store, args);
 	else if (strcmp(cmd, "delete") == 0)
-		return delete(fs_store);
+		return delete(fs_store, wal, args);
 	else if (strcmp(cmd, "search") == 0)
-		return search(fs_store);
+		return search(fs_store, args);
+	else if (strcmp(cmd, "count") == 0)
+		return count(fs_store, args);
+	else if (strcmp(cmd, "children") == 0)
+		return children(fs_store, args);
+	else if (strcmp(cmd, "nth") == 0)
+		return nth(fs_store, args);
+	else if (strcmp(cmd, "save") == 0)
+		return save(fs_store, wal, args);
+	else if (strcmp(cmd, "load") == 0)
+		return load(fs_store, wal, args);
+	else if (strcmp(cmd, "snapshot") == 0)
+		return snapshot(fs_store);
+	else if (strcmp(cmd, "sprint") == 0)
+		return sprint(fs_store, args);
+	else if (strcmp(cmd, "ssearch") == 0)
+		return ssearch(fs_store, args);
+	else if (strcmp(cmd, "release") == 0)
+		return release(fs_store, args);
+	else if (strcmp(cmd, "bulk") == 0)
+		return bulk(fs_store, wal, args);
+	else if (strcmp(cmd, "stats") == 0)
+		return stats(fs_store);
 	else if (strcmp(cmd, "quit") == 0)
 		return quit(fs_store);
 	else
@@ -118,27 +368,140 @@ int select(struct FS* fs_store) {
 }
 
 
+/************************************************
+ * OPTIONS: Given by the flags before the input
+ *    file.
+ * - snapshot: Snapshot loaded at the start, or
+ *    NULL.
+ *
+ * - gen: Log generation the snapshot loaded at
+ *    the start was stamped with.
+ *
+ * - log: Write-ahead log, or NULL to run without
+ *    one.
+ *
+ * - group: Records of the log synced at once.
+ *
+ * - interval: Longest time, in milliseconds, a
+ *    record of the log waits to be synced.
+ *************************************************/
+struct Options {
+	char* snapshot;
+	unsigned long gen;
+	char* log;
+	int group, interval;
+};
+
+/*
+ * READ FLAGS: Reads the flags, each followed by
+ *    its argument, into the options. Returns the
+ *    index of the first argument after them, or
+ *    0 if one of them is invalid.
+ */
+int read_flags(int argc, char* argv[], struct Options* opt) {
+	int arg;
+
+	opt->snapshot = opt->log = NULL;
+	opt->gen = 0;
+	opt->group = WAL_GROUP;
+	opt->interval = WAL_INTERVAL;
+
+	for (arg = 1; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+		if (strcmp(argv[arg], LOAD_FLAG) == 0)
+			opt->snapshot = argv[arg + 1];
+		else if (strcmp(argv[arg], WAL_FLAG) == 0)
+			opt->log = argv[arg + 1];
+		else if (strcmp(argv[arg], GROUP_FLAG) == 0)
+			read_count(argv[arg + 1], &opt->group);
+		else if (strcmp(argv[arg], INTERVAL_FLAG) == 0)
+			read_count(argv[arg + 1], &opt->interval);
+		else
+			return 0;
+	}
+	if (opt->group < 1 || opt->interval < 0)
+		return 0;
+
+	return arg;
+}
+
+/*
+ * RECOVER: Opens the log and replays it on top of
+ *    the filesystem, first loading the log's own
+ *    snapshot when no other was given. Returns
+ *    NULL if it fails.
+ */
+struct Wal* recover(struct Options* opt, struct FS* fs_store) {
+	struct Wal* wal = wal_open(opt->log, opt->snapshot, opt->group,
+	                                                   opt->interval);
+	char* base;
+
+	if (wal != NULL && opt->snapshot == NULL && (base = wal_base(wal)) != NULL &&
+	    fs_load_gen(fs_store, base, &opt->gen) != OK) {
+		wal_close(wal);
+		return NULL;
+	}
+	if (wal != NULL && !wal_replay(wal, opt->gen, replay, fs_store)) {
+		wal_close(wal);
+		return NULL;
+	}
+	return wal;
+}
+
+
 /*
  * MAIN FUNCTION: Setups the filesystem and runs
  *    the loop handling any error or request by
- *    the user to stop.
+ *    the user to stop. Commands are read from the
+ *    file given as argument, or from stdin. The
+ *    filesystem starts from the snapshot given
+ *    after LOAD_FLAG, if any, and then from the
+ *    log given after WAL_FLAG, which records
+ *    every change from then on.
  */
-int main() {
+int main(int argc, char* argv[]) {
 	int status = KEEP_GOING;
-	struct FS* fs_store = fs_init();
+	struct Options opt;
+	struct FS* fs_store;
+	struct Wal* wal = NULL;
+	struct Input* in;
+	int arg = read_flags(argc, argv, &opt);
+
+	if (arg == 0)
+		return EXIT_ERR;
+	in = in_open(argc > arg ? argv[arg] : NULL);
+	if (in == NULL)
+		return EXIT_ERR;
+
+	fs_store = fs_init();
+	if ((opt.snapshot != NULL && fs_load_gen(fs_store, opt.snapshot, &opt.gen) != OK) ||
+	    (opt.log != NULL && (wal = recover(&opt, fs_store)) == NULL)) {
+		fs_destroy(fs_store);
+		in_close(in);
+		return EXIT_ERR;
+	}
 
 	while (status == KEEP_GOING) {
-		switch (select(fs_store)) {
+		/* Only sync the log and hand the output over before waiting */
+		if (!in_pending(in)) {
+			if (wal != NULL && !wal_commit(wal))
+				out_line(ERR_MSG_IO);
+			out_flush();
+		}
+
+		switch (select(fs_store, wal, in)) {
 				case OK:
 					break;
 				case ERR_NOT_FOUND:
-					puts(ERR_MSG_NOT_FOUND);
+					out_line(ERR_MSG_NOT_FOUND);
 					break;
 				case ERR_NO_DATA:
-					puts(ERR_MSG_NO_DATA);
+					out_line(ERR_MSG_NO_DATA);
+					break;
+				case ERR_IO:
+					out_line(ERR_MSG_IO);
 					break;
 				case ERR_NO_MEMORY:
-					puts(ERR_MSG_NO_MEMORY);
+					out_line(ERR_MSG_NO_MEMORY);
 					quit(fs_store);
 					status = STOP;
 					break;
@@ -148,6 +511,10 @@ int main() {
 			}
 	}
 
-	return EXIT_OK;
+	if (wal != NULL)
+		wal_close(wal);
+	out_flush();
+	status = in_error(in) == IN_OK ? EXIT_OK : EXIT_ERR;
+	in_close(in);
+	return status;
 }
-
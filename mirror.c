@@ -0,0 +1,207 @@
+/*
+ * File:	mirror.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Mirrored store implementation, the paths are kept in two
+ *    filesystems with the same contents. Readers use one of them
+ *    while a change is made to the other, which then takes its
+ *    place, and the change is repeated on the first once its
+ *    readers are gone, so reads never wait for a change.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "fs.h"
+#include "mirror.h"
+
+#define MIRROR_SET 1
+#define MIRROR_REMOVE 2
+
+/************************************************
+ * MIRROR: Shared by any amount of threads.
+ * - fs: The two copies of the filesystem.
+ *
+ * - side: Copy new readers use.
+ *
+ * - readers: Readers using each copy.
+ *
+ * - mutex: Guards side and readers, only held
+ *    while they're read or changed.
+ *
+ * - drained: Signaled when a copy has no more
+ *    readers.
+ *
+ * - write_mutex: Held by the thread making a
+ *    change, one at a time.
+ *************************************************/
+struct Mirror {
+	struct FS* fs[2];
+	int side;
+	int readers[2];
+	pthread_mutex_t mutex;
+	pthread_cond_t drained;
+	pthread_mutex_t write_mutex;
+};
+
+/*
+ * MIRROR NEW: Creates an empty store. Returns
+ *    NULL if it fails.
+ */
+struct Mirror* mirror_new() {
+	struct Mirror* m = malloc(sizeof(struct Mirror));
+
+	if (m == NULL)
+		return NULL;
+	m->fs[0] = fs_init();
+	m->fs[1] = fs_init();
+	if (m->fs[0] == NULL || m->fs[1] == NULL) {
+		if (m->fs[0] != NULL)
+			fs_destroy(m->fs[0]);
+		if (m->fs[1] != NULL)
+			fs_destroy(m->fs[1]);
+		free(m);
+		return NULL;
+	}
+
+	m->side = 0;
+	m->readers[0] = m->readers[1] = 0;
+	pthread_mutex_init(&m->mutex, NULL);
+	pthread_cond_init(&m->drained, NULL);
+	pthread_mutex_init(&m->write_mutex, NULL);
+	return m;
+}
+
+/*
+ * ENTER SIDE: Registers a reader and returns the
+ *    copy it reads.
+ */
+int enter_side(struct Mirror* m) {
+	int side;
+
+	pthread_mutex_lock(&m->mutex);
+	side = m->side;
+	m->readers[side]++;
+	pthread_mutex_unlock(&m->mutex);
+	return side;
+}
+
+/*
+ * LEAVE SIDE: Unregisters a reader of the given
+ *    copy.
+ */
+void leave_side(struct Mirror* m, int side) {
+	pthread_mutex_lock(&m->mutex);
+	if (--m->readers[side] == 0)
+		pthread_cond_broadcast(&m->drained);
+	pthread_mutex_unlock(&m->mutex);
+}
+
+/*
+ * APPLY CHANGE: Makes a change to one copy, on a
+ *    copy of the path since it's overwritten.
+ */
+int apply_change(struct FS* fs, int op, char* path, char* buf, char* value) {
+	strcpy(buf, path);
+	if (op == MIRROR_SET)
+		return fs_set(fs, buf, value);
+	return fs_remove(fs, buf);
+}
+
+/*
+ * CHANGE BOTH: Makes a change to the copy no
+ *    reader uses, switches the readers to it and
+ *    makes it to the other copy once its readers
+ *    left.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory, the copies may differ.
+ */
+int change_both(struct Mirror* m, int op, char* path, char* value) {
+	char* buf = malloc(strlen(path) + 1);
+	int status, side;
+
+	if (buf == NULL)
+		return ERR_NO_MEMORY;
+
+	pthread_mutex_lock(&m->write_mutex);
+	/* Only the thread making a change switches sides */
+	side = !m->side;
+	status = apply_change(m->fs[side], op, path, buf, value);
+
+	pthread_mutex_lock(&m->mutex);
+	m->side = side;
+	while (m->readers[!side] > 0)
+		pthread_cond_wait(&m->drained, &m->mutex);
+	pthread_mutex_unlock(&m->mutex);
+
+	if (status != ERR_NO_MEMORY &&
+	    apply_change(m->fs[!side], op, path, buf, value) == ERR_NO_MEMORY)
+		status = ERR_NO_MEMORY;
+	pthread_mutex_unlock(&m->write_mutex);
+
+	free(buf);
+	return status;
+}
+
+/*
+ * MIRROR SET: Sets a path's value.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int mirror_set(struct Mirror* m, char* path, char* value) {
+	return change_both(m, MIRROR_SET, path, value);
+}
+
+/*
+ * MIRROR REMOVE: Removes a path and everything
+ *    under it.
+ * - ERR_NOT_FOUND: The path does not exist.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int mirror_remove(struct Mirror* m, char* path) {
+	return change_both(m, MIRROR_REMOVE, path, NULL);
+}
+
+/*
+ * MIRROR READS: The following functions read the
+ *    copy no change is being made to, with the
+ *    results of fs_find, fs_list and fs_search.
+ */
+int mirror_find(struct Mirror* m, char* path) {
+	int side = enter_side(m);
+	int status = fs_find(m->fs[side], path);
+
+	leave_side(m, side);
+	return status;
+}
+
+int mirror_list(struct Mirror* m, char* path, char* start, int count) {
+	int side = enter_side(m);
+	int status = fs_list(m->fs[side], path, start, count);
+
+	leave_side(m, side);
+	return status;
+}
+
+int mirror_search(struct Mirror* m, char* value) {
+	int side = enter_side(m);
+	int status = fs_search(m->fs[side], value);
+
+	leave_side(m, side);
+	return status;
+}
+
+/*
+ * MIRROR DESTROY: Frees both copies, with no
+ *    readers or changes left.
+ */
+void mirror_destroy(struct Mirror* m) {
+	fs_destroy(m->fs[0]);
+	fs_destroy(m->fs[1]);
+	pthread_mutex_destroy(&m->mutex);
+	pthread_cond_destroy(&m->drained);
+	pthread_mutex_destroy(&m->write_mutex);
+	free(m);
+}
@@ -0,0 +1,15 @@
+/*
+ * File:	mirror.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the mirrored store interface.
+ */
+
+struct Mirror;
+
+struct Mirror* mirror_new();
+int mirror_set(struct Mirror* m, char* path, char* value);
+int mirror_remove(struct Mirror* m, char* path);
+int mirror_find(struct Mirror* m, char* path);
+int mirror_list(struct Mirror* m, char* path, char* start, int count);
+int mirror_search(struct Mirror* m, char* value);
+void mirror_destroy(struct Mirror* m);
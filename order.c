@@ -0,0 +1,112 @@
+/*
+ * File:	order.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Order maintenance implementation, keeps integer labels
+ *    on a list so any two elements can be ordered in O(1).
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include "order.h"
+
+/*
+ * ORDER INIT: Starts a list with the given tags,
+ *    they take the smallest and biggest labels
+ *    and every other tag goes between them.
+ */
+void order_init(struct Tag* first, struct Tag* last) {
+	first->label = 0;
+	last->label = ULONG_MAX;
+	first->prev = last->next = NULL;
+	first->next = last;
+	last->prev = first;
+}
+
+/*
+ * RELABEL: Spreads the labels around the given
+ *    tag, which was just inserted. The range of
+ *    tags grows to both sides until its labels
+ *    are sparse enough: a range with j gaps is
+ *    sparse once its width is bigger than j
+ *    squared. The ends of the range keep their
+ *    labels, so the first and last tags of the
+ *    list never change.
+ */
+void relabel(struct Tag* t) {
+	struct Tag *lo = t->prev, *hi = t->next;
+	unsigned long j = 2, gap;
+
+	while (hi->label - lo->label <= j * j) {
+		if (lo->prev != NULL) {
+			lo = lo->prev;
+			j++;
+		}
+		if (hi->next != NULL) {
+			hi = hi->next;
+			j++;
+		}
+		if (lo->prev == NULL && hi->next == NULL)
+			break;
+	}
+
+	gap = (hi->label - lo->label) / j;
+	for (t = lo->next; t != hi; t = t->next)
+		t->label = t->prev->label + gap;
+}
+
+/*
+ * ORDER INSERT: Inserts a tag right before the
+ *    given one, which can't be the first.
+ */
+void order_insert(struct Tag* t, struct Tag* before) {
+	struct Tag* a = before->prev;
+
+	t->prev = a;
+	t->next = before;
+	a->next = t;
+	before->prev = t;
+
+	if (before->label - a->label >= 2)
+		t->label = a->label + (before->label - a->label) / 2;
+	else
+		relabel(t);
+}
+
+/*
+ * ORDER PUSH: Links a tag right before the given
+ *    one without labelling it, for lists built
+ *    all at once and labelled by order_spread.
+ */
+void order_push(struct Tag* t, struct Tag* before) {
+	t->prev = before->prev;
+	t->next = before;
+	before->prev->next = t;
+	before->prev = t;
+}
+
+/*
+ * ORDER SPREAD: Labels every tag between first
+ *    and last with evenly spaced labels, taking
+ *    a single pass over the list.
+ */
+void order_spread(struct Tag* first, struct Tag* last) {
+	struct Tag* t;
+	unsigned long j = 1, gap;
+
+	for (t = first->next; t != last; t = t->next)
+		j++;
+
+	gap = (last->label - first->label) / j;
+	for (t = first->next; t != last; t = t->next)
+		t->label = t->prev->label + gap;
+}
+
+/*
+ * ORDER CUT: Takes the tags from first to last
+ *    out of the list, the labels of the others
+ *    don't change.
+ */
+void order_cut(struct Tag* first, struct Tag* last) {
+	first->prev->next = last->next;
+	last->next->prev = first->prev;
+}
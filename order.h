@@ -0,0 +1,23 @@
+/*
+ * File:	order.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the order maintenance interface.
+ */
+
+/************************************************
+ * TAG: Element of an ordered list, tags can be
+ *    ordered by comparing their labels.
+ * - label: Increases along the list.
+ *
+ * - prev, next: Neighbours in the list.
+ *************************************************/
+struct Tag {
+	unsigned long label;
+	struct Tag *prev, *next;
+};
+
+void order_init(struct Tag* first, struct Tag* last);
+void order_insert(struct Tag* t, struct Tag* before);
+void order_push(struct Tag* t, struct Tag* before);
+void order_spread(struct Tag* first, struct Tag* last);
+void order_cut(struct Tag* first, struct Tag* last);
@@ -0,0 +1,174 @@
+/*
+ * File:	output.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Output buffer implementation, gathers everything that is
+ *    printed and hands it to the system in big writes. Every thread
+ *    prints to a buffer of its own.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "output.h"
+
+#define OUT_SZ 1048576
+
+/************************************************
+ * OUTPUT BUFFER:
+ * - buf: Bytes waiting to be written.
+ *
+ * - len: Amount of bytes waiting.
+ *************************************************/
+struct OutBuf {
+	char buf[OUT_SZ];
+	size_t len;
+};
+
+/*
+ * OUTPUT KEY: Buffer of each thread, created the
+ *    first time it prints.
+ */
+static pthread_key_t out_key;
+static pthread_once_t out_once = PTHREAD_ONCE_INIT;
+
+/*
+ * WRITE ALL: Writes the given bytes to stdout.
+ */
+void write_all(char* s, size_t n) {
+	ssize_t w;
+
+	while (n > 0) {
+		w = write(STDOUT_FILENO, s, n);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			return;
+		s += w;
+		n -= w;
+	}
+}
+
+/*
+ * RELEASE BUFFER: Writes what is left in the
+ *    buffer of a thread that exited and frees it.
+ */
+void release_buf(void* b) {
+	struct OutBuf* out = b;
+
+	write_all(out->buf, out->len);
+	free(out);
+}
+
+/*
+ * CREATE OUTPUT KEY
+ */
+void create_out_key() {
+	pthread_key_create(&out_key, release_buf);
+}
+
+/*
+ * THREAD BUFFER: Returns the buffer of the
+ *    calling thread, or NULL if it can't be
+ *    allocated, the output is then written
+ *    directly.
+ */
+struct OutBuf* thread_buf() {
+	struct OutBuf* out;
+
+	pthread_once(&out_once, create_out_key);
+	out = pthread_getspecific(out_key);
+	if (out != NULL)
+		return out;
+
+	out = malloc(sizeof(struct OutBuf));
+	if (out == NULL)
+		return NULL;
+	out->len = 0;
+	if (pthread_setspecific(out_key, out) != 0) {
+		free(out);
+		return NULL;
+	}
+	return out;
+}
+
+/*
+ * OUTPUT FLUSH: Writes everything in the buffer.
+ */
+void out_flush() {
+	struct OutBuf* out = thread_buf();
+
+	if (out != NULL) {
+		write_all(out->buf, out->len);
+		out->len = 0;
+	}
+}
+
+/*
+ * OUTPUT MEMORY: Appends the given bytes to the
+ *    buffer, flushing it when full. Blocks bigger
+ *    than the buffer are written directly.
+ */
+void out_mem(char* s, size_t n) {
+	struct OutBuf* out = thread_buf();
+
+	if (out == NULL || out->len + n > OUT_SZ) {
+		out_flush();
+		if (out == NULL || n > OUT_SZ) {
+			write_all(s, n);
+			return;
+		}
+	}
+	memcpy(out->buf + out->len, s, n);
+	out->len += n;
+}
+
+/*
+ * OUTPUT STRING
+ */
+void out_str(char* s) {
+	out_mem(s, strlen(s));
+}
+
+/*
+ * OUTPUT CHARACTER
+ */
+void out_chr(char c) {
+	struct OutBuf* out = thread_buf();
+
+	if (out == NULL) {
+		write_all(&c, 1);
+		return;
+	}
+	if (out->len == OUT_SZ)
+		out_flush();
+	out->buf[out->len++] = c;
+}
+
+/*
+ * OUTPUT LINE: Appends the string followed by a
+ *    line break.
+ */
+void out_line(char* s) {
+	out_str(s);
+	out_chr('\n');
+}
+
+/*
+ * OUTPUT NUMBER: Appends the number in decimal.
+ */
+void out_num(long n) {
+	char digits[24];
+	int i = sizeof(digits);
+	unsigned long u = n < 0 ? -(unsigned long)n : (unsigned long)n;
+
+	do
+		digits[--i] = '0' + u % 10;
+	while ((u /= 10) > 0);
+	if (n < 0)
+		digits[--i] = '-';
+	out_mem(digits + i, sizeof(digits) - i);
+}
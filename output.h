@@ -0,0 +1,14 @@
+/*
+ * File:	output.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the output buffer interface.
+ */
+
+#include <stddef.h>
+
+void out_mem(char* s, size_t n);
+void out_str(char* s);
+void out_chr(char c);
+void out_line(char* s);
+void out_num(long n);
+void out_flush();
@@ -0,0 +1,272 @@
+/*
+ * File:	pool.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Memory pool and string arena implementation.
+ */
+
+#include <stdlib.h>
+#include "pool.h"
+
+#define SLAB_MIN_ELS 64
+#define SLAB_MAX_ELS 65536
+#define CHUNK_MIN_SZ 4096
+#define CHUNK_MAX_SZ 1048576
+#define STR_ALIGN sizeof(void*)
+#define SMALL_STR_SZ 512
+#define STR_CLASSES (SMALL_STR_SZ / STR_ALIGN)
+
+/************************************************
+ * SLAB: Header of every block of memory taken
+ *    from the system, the pool's elements or the
+ *    arena's strings follow it.
+ * - next: Block taken before this one.
+ *************************************************/
+struct Slab {
+	struct Slab* next;
+};
+
+/************************************************
+ * BIG STRING: Header of a string too big for
+ *    the arena's blocks, these are allocated on
+ *    their own.
+ * - prev, next: Neighbours in the arena's list.
+ *************************************************/
+struct Big {
+	struct Big *prev, *next;
+};
+
+/************************************************
+ * POOL:
+ * - el_sz: Size of each element.
+ *
+ * - slab_els: Elements in the next slab.
+ *
+ * - slabs: Every slab of the pool.
+ *
+ * - bump, end: Unused space in the last slab.
+ *
+ * - free: Linked list of released elements.
+ *************************************************/
+struct Pool {
+	size_t el_sz;
+	size_t slab_els;
+	struct Slab* slabs;
+	char *bump, *end;
+	void* free;
+};
+
+/************************************************
+ * ARENA:
+ * - chunk_sz: Size of the next chunk.
+ *
+ * - chunks: Every chunk of the arena.
+ *
+ * - bump, end: Unused space in the last chunk.
+ *
+ * - free: Linked lists of released strings, one
+ *    per size class.
+ *
+ * - big: Strings allocated on their own.
+ *************************************************/
+struct Arena {
+	size_t chunk_sz;
+	struct Slab* chunks;
+	char *bump, *end;
+	char* free[STR_CLASSES];
+	struct Big* big;
+};
+
+/*
+ * POOL NEW: Creates a pool of elements with the
+ *    given size.
+ */
+struct Pool* pool_new(size_t el_sz) {
+	struct Pool* p = malloc(sizeof(struct Pool));
+	if (p == NULL)
+		return NULL;
+
+	/* Released elements hold the free list's link */
+	if (el_sz < sizeof(void*))
+		el_sz = sizeof(void*);
+	p->el_sz = (el_sz + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+	p->slab_els = SLAB_MIN_ELS;
+	p->slabs = NULL;
+	p->bump = p->end = NULL;
+	p->free = NULL;
+	return p;
+}
+
+/*
+ * POOL ALLOC: Returns an element, reusing the
+ *    released ones first.
+ */
+void* pool_alloc(struct Pool* p) {
+	void* el;
+
+	if (p->free != NULL) {
+		el = p->free;
+		p->free = *(void**)el;
+		return el;
+	}
+
+	if (p->bump == p->end) {
+		struct Slab* s = malloc(sizeof(struct Slab) + p->slab_els * p->el_sz);
+		if (s == NULL)
+			return NULL;
+		s->next = p->slabs;
+		p->slabs = s;
+		p->bump = (char*)(s + 1);
+		p->end = p->bump + p->slab_els * p->el_sz;
+		if (p->slab_els < SLAB_MAX_ELS)
+			p->slab_els *= 2;
+	}
+
+	el = p->bump;
+	p->bump += p->el_sz;
+	return el;
+}
+
+/*
+ * POOL FREE: Releases an element back into the
+ *    pool.
+ */
+void pool_free(struct Pool* p, void* el) {
+	*(void**)el = p->free;
+	p->free = el;
+}
+
+/*
+ * POOL DESTROY: Frees the pool with every element
+ *    at once.
+ */
+void pool_destroy(struct Pool* p) {
+	struct Slab* s;
+
+	if (p == NULL)
+		return;
+
+	while ((s = p->slabs) != NULL) {
+		p->slabs = s->next;
+		free(s);
+	}
+	free(p);
+}
+
+/*
+ * ARENA NEW: Creates an arena for strings.
+ */
+struct Arena* arena_new() {
+	int i;
+	struct Arena* a = malloc(sizeof(struct Arena));
+	if (a == NULL)
+		return NULL;
+
+	a->chunk_sz = CHUNK_MIN_SZ;
+	a->chunks = NULL;
+	a->bump = a->end = NULL;
+	for (i = 0; i < (int)STR_CLASSES; i++)
+		a->free[i] = NULL;
+	a->big = NULL;
+	return a;
+}
+
+/*
+ * STRING CLASS: Returns the size class of a
+ *    string with the given size.
+ */
+size_t str_class(size_t n) {
+	return (n + STR_ALIGN - 1) / STR_ALIGN - 1;
+}
+
+/*
+ * ARENA BIG: Allocates a string on its own.
+ */
+char* arena_big(struct Arena* a, size_t n) {
+	struct Big* b = malloc(sizeof(struct Big) + n);
+	if (b == NULL)
+		return NULL;
+
+	b->prev = NULL;
+	b->next = a->big;
+	if (a->big != NULL)
+		a->big->prev = b;
+	a->big = b;
+	return (char*)(b + 1);
+}
+
+/*
+ * ARENA ALLOC: Returns a block of memory with the
+ *    given size from the arena, or NULL if it
+ *    fails to allocate memory.
+ */
+void* arena_alloc(struct Arena* a, size_t n) {
+	size_t c = str_class(n);
+	char* str;
+
+	if (n > SMALL_STR_SZ)
+		return arena_big(a, n);
+
+	if (a->free[c] != NULL) {
+		str = a->free[c];
+		a->free[c] = *(char**)str;
+		return str;
+	}
+
+	if ((size_t)(a->end - a->bump) < (c + 1) * STR_ALIGN) {
+		struct Slab* ch = malloc(sizeof(struct Slab) + a->chunk_sz);
+		if (ch == NULL)
+			return NULL;
+		ch->next = a->chunks;
+		a->chunks = ch;
+		a->bump = (char*)(ch + 1);
+		a->end = a->bump + a->chunk_sz;
+		if (a->chunk_sz < CHUNK_MAX_SZ)
+			a->chunk_sz *= 2;
+	}
+	str = a->bump;
+	a->bump += (c + 1) * STR_ALIGN;
+	return str;
+}
+
+/*
+ * ARENA FREE: Releases a block of the given size
+ *    from the arena so its space can be reused.
+ */
+void arena_free(struct Arena* a, void* s, size_t n) {
+	if (n > SMALL_STR_SZ) {
+		struct Big* b = (struct Big*)s - 1;
+		if (b->prev != NULL)
+			b->prev->next = b->next;
+		else
+			a->big = b->next;
+		if (b->next != NULL)
+			b->next->prev = b->prev;
+		free(b);
+	} else {
+		size_t c = str_class(n);
+		*(char**)s = a->free[c];
+		a->free[c] = s;
+	}
+}
+
+/*
+ * ARENA DESTROY: Frees the arena with every
+ *    string at once.
+ */
+void arena_destroy(struct Arena* a) {
+	struct Slab* ch;
+	struct Big* b;
+
+	if (a == NULL)
+		return;
+
+	while ((ch = a->chunks) != NULL) {
+		a->chunks = ch->next;
+		free(ch);
+	}
+	while ((b = a->big) != NULL) {
+		a->big = b->next;
+		free(b);
+	}
+	free(a);
+}
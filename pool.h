@@ -0,0 +1,21 @@
+/*
+ * File:	pool.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the memory pool and string arena
+ *    interfaces.
+ */
+
+#include <stddef.h>
+
+struct Pool;
+struct Arena;
+
+struct Pool* pool_new(size_t el_sz);
+void* pool_alloc(struct Pool* p);
+void pool_free(struct Pool* p, void* el);
+void pool_destroy(struct Pool* p);
+
+struct Arena* arena_new();
+void* arena_alloc(struct Arena* a, size_t n);
+void arena_free(struct Arena* a, void* s, size_t n);
+void arena_destroy(struct Arena* a);
@@ -0,0 +1,402 @@
+/*
+ * File:	shard.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Sharded store implementation, every top-level directory
+ *    lives with its subdirectories in one of several filesystems,
+ *    picked by the hash of its name, so a batch of changes is split
+ *    and applied to them in parallel.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include "hashtable.h"
+#include "output.h"
+#include "fs.h"
+#include "shard.h"
+
+#define ROOT_SEQ -1
+
+/************************************************
+ * TOP: Top-level directory.
+ * - seq: Position by creation order, the root is
+ *    ROOT_SEQ. Directories under an older one
+ *    are printed first, which decides the search
+ *    result among those found in each shard.
+ *
+ * - name: Relative path.
+ *************************************************/
+struct Top {
+	long seq;
+	char name[1];
+};
+
+/************************************************
+ * SHARDS: Used by one thread at a time, the
+ *    threads are started by the batches.
+ * - fs: Filesystem of each shard.
+ *
+ * - n: Amount of shards.
+ *
+ * - tops: Table of the top-level directories.
+ *
+ * - next_seq: Position of the next top-level
+ *    directory created.
+ *************************************************/
+struct Shards {
+	struct FS** fs;
+	int n;
+	struct HashTable* tops;
+	long next_seq;
+};
+
+/************************************************
+ * WORKER: Thread applying a shard's part of a
+ *    batch.
+ * - fs: Filesystem of the shard.
+ *
+ * - ops: The batch.
+ *
+ * - queue: Positions in the batch of the changes
+ *    of the shard, in order.
+ *
+ * - len: Amount of them.
+ *
+ * - id: The thread.
+ *************************************************/
+struct Worker {
+	struct FS* fs;
+	struct ShardOp* ops;
+	int* queue;
+	int len;
+	pthread_t id;
+};
+
+/*
+ * TOP NAME: Given a top-level directory return
+ *    the relative path.
+ */
+char* top_name(void* top) {
+	return ((struct Top*)top)->name;
+}
+
+/*
+ * SAME TOP: Returns 0 if both are the same.
+ */
+int same_top(void* top1, void* top2) {
+	return top1 != top2;
+}
+
+/*
+ * DROP TOP: Frees a top-level directory, used to
+ *    empty the table.
+ */
+int drop_top(void* top, void* extra) {
+	/* No extra arguments are needed */
+	(void)extra;
+
+	free(top);
+	return 0;
+}
+
+/*
+ * TOP COMPONENT: Stores where the first relative
+ *    path of a path starts and returns its
+ *    length, 0 for the root.
+ */
+size_t top_component(char* path, char** start) {
+	*start = path + strspn(path, PATH_DELIMITER);
+	return strcspn(*start, PATH_DELIMITER);
+}
+
+/*
+ * SHARD OF: Returns the shard holding a path.
+ */
+int shard_of(struct Shards* sh, char* path) {
+	char* s;
+	size_t len = top_component(path, &s);
+
+	return ht_hash_len(s, len) % sh->n;
+}
+
+/*
+ * FIND TOP: Returns the top-level directory of a
+ *    path, NULL if there is none, and stores
+ *    whether the path is the directory itself.
+ */
+struct Top* find_top(struct Shards* sh, char* path, int* whole) {
+	struct Top* top;
+	char* s;
+	size_t len = top_component(path, &s);
+	char c = s[len];
+
+	/* The name is cut out of the path for a moment */
+	s[len] = '\0';
+	top = ht_find(sh->tops, s, top_name);
+	s[len] = c;
+
+	s += len;
+	*whole = s[strspn(s, PATH_DELIMITER)] == '\0';
+	return top;
+}
+
+/*
+ * TRACK: Keeps the table of the top-level
+ *    directories up to date with a change, the
+ *    changes being taken in the batch's order.
+ *    Returns 0 if it fails to allocate memory.
+ */
+int track(struct Shards* sh, struct ShardOp* op) {
+	struct Top* top;
+	char* s;
+	size_t len = top_component(op->path, &s);
+	int whole;
+
+	if (len == 0) {
+		if (op->op == SHARD_DELETE)
+			sh->tops = ht_filter(sh->tops, drop_top, NULL);
+		return 1;
+	}
+
+	top = find_top(sh, op->path, &whole);
+	if (op->op == SHARD_SET && top == NULL) {
+		top = malloc(sizeof(struct Top) + len);
+		if (top == NULL)
+			return 0;
+		top->seq = sh->next_seq++;
+		memcpy(top->name, s, len);
+		top->name[len] = '\0';
+		sh->tops = ht_insert(sh->tops, top, top_name);
+		return sh->tops != NULL;
+	} else if (op->op == SHARD_DELETE && top != NULL && whole) {
+		sh->tops = ht_remove(sh->tops, top, top_name, same_top);
+		free(top);
+	}
+	return 1;
+}
+
+/*
+ * APPLY QUEUE: Applies the changes of a worker's
+ *    queue in order, storing their results.
+ */
+void* apply_queue(void* arg) {
+	struct Worker* w = arg;
+	struct ShardOp* op;
+	int i;
+
+	for (i = 0; i < w->len; i++) {
+		op = &w->ops[w->queue[i]];
+		if (op->op == SHARD_SET)
+			op->status = fs_set(w->fs, op->path, op->value);
+		else
+			op->status = fs_remove(w->fs, op->path);
+	}
+	return NULL;
+}
+
+/*
+ * APPLY SPLIT: Splits changes none of which
+ *    removes the root by shard and applies them
+ *    with a thread per shard. Returns 0 if it
+ *    fails to allocate memory.
+ */
+int apply_split(struct Shards* sh, struct ShardOp* ops, int n) {
+	struct Worker* w = malloc(sh->n * sizeof(struct Worker));
+	int* queue = malloc(n * sizeof(int));
+	int* of = malloc(n * sizeof(int));
+	int i, k, busy = 0, ok = w != NULL && queue != NULL && of != NULL;
+
+	if (!ok) {
+		free(w);
+		free(queue);
+		free(of);
+		return 0;
+	}
+
+	for (k = 0; k < sh->n; k++) {
+		w[k].fs = sh->fs[k];
+		w[k].ops = ops;
+		w[k].len = 0;
+	}
+	for (i = 0; i < n; i++)
+		w[of[i] = shard_of(sh, ops[i].path)].len++;
+
+	/* Each queue takes its part of the array, in order */
+	for (i = k = 0; k < sh->n; i += w[k++].len) {
+		w[k].queue = queue + i;
+		busy += w[k].len > 0;
+	}
+	for (k = 0; k < sh->n; k++)
+		w[k].len = 0;
+	for (i = 0; i < n; i++)
+		w[of[i]].queue[w[of[i]].len++] = i;
+
+	/* A shard alone is applied without a thread */
+	for (k = 0; k < sh->n; k++) {
+		if (w[k].len > 0 && (busy == 1 ||
+		    pthread_create(&w[k].id, NULL, apply_queue, &w[k]) != 0)) {
+			apply_queue(&w[k]);
+			w[k].len = 0;
+		}
+	}
+	for (k = 0; k < sh->n; k++) {
+		if (w[k].len > 0)
+			pthread_join(w[k].id, NULL);
+	}
+
+	for (i = 0; ok && i < n; i++)
+		ok = ops[i].status != ERR_NO_MEMORY;
+	free(w);
+	free(queue);
+	free(of);
+	return ok;
+}
+
+/*
+ * REMOVE ROOT: Removes the root of every shard,
+ *    it was found if any of them had one.
+ */
+int remove_root(struct Shards* sh) {
+	int k, s, status = ERR_NOT_FOUND;
+
+	for (k = 0; k < sh->n; k++) {
+		s = fs_remove(sh->fs[k], FS_ROOT);
+		if (s == ERR_NO_MEMORY || (s == OK && status == ERR_NOT_FOUND))
+			status = s;
+	}
+	return status;
+}
+
+/*
+ * SHARDS NEW: Creates a store of n empty shards.
+ */
+struct Shards* shards_new(int n) {
+	struct Shards* sh = malloc(sizeof(struct Shards));
+	int k;
+
+	if (sh == NULL)
+		return NULL;
+	sh->fs = malloc(n * sizeof(struct FS*));
+	if (sh->fs == NULL) {
+		free(sh);
+		return NULL;
+	}
+	sh->n = 0;
+	sh->tops = NULL;
+	sh->next_seq = 0;
+
+	for (k = 0; k < n; k++) {
+		sh->fs[k] = fs_init();
+		if (sh->fs[k] == NULL) {
+			shards_destroy(sh);
+			return NULL;
+		}
+		sh->n++;
+	}
+	return sh;
+}
+
+/*
+ * SHARDS APPLY: Applies a batch of changes, each
+ *    shard's in the batch's order and the shards
+ *    in parallel. Removing the root waits for
+ *    the changes before it to be applied. The
+ *    result of each change is stored with it.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int shards_apply(struct Shards* sh, struct ShardOp* ops, int n) {
+	char* s;
+	int i, start = 0;
+
+	for (i = 0; i < n; i++) {
+		if (!track(sh, &ops[i]))
+			return ERR_NO_MEMORY;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (ops[i].op != SHARD_DELETE || top_component(ops[i].path, &s) > 0)
+			continue;
+		if (i > start && !apply_split(sh, ops + start, i - start))
+			return ERR_NO_MEMORY;
+		ops[i].status = remove_root(sh);
+		start = i + 1;
+	}
+	if (n > start && !apply_split(sh, ops + start, n - start))
+		return ERR_NO_MEMORY;
+
+	return OK;
+}
+
+/*
+ * SHARDS FIND: Print the value in a given path.
+ * - ERR_NOT_FOUND: The directory does not exist.
+ * - ERR_NO_DATA: The path has no value.
+ */
+int shards_find(struct Shards* sh, char* path) {
+	return fs_find(sh->fs[shard_of(sh, path)], path);
+}
+
+/*
+ * SHARDS SEARCH: Print full path of the first
+ *    directory printed with the given value,
+ *    searched for in every shard.
+ * - ERR_NOT_FOUND: The value was not found.
+ * - ERR_NO_MEMORY: The program failed to
+ *    allocate memory.
+ */
+int shards_search(struct Shards* sh, char* value) {
+	char *path, *best = NULL, *s;
+	long seq, best_seq = LONG_MAX;
+	struct Top* top;
+	int k, whole, status;
+
+	for (k = 0; k < sh->n; k++) {
+		status = fs_locate(sh->fs[k], value, &path);
+		if (status == ERR_NO_MEMORY) {
+			free(best);
+			return status;
+		} else if (status != OK) {
+			continue;
+		}
+
+		if (top_component(path, &s) == 0)
+			seq = ROOT_SEQ;
+		else if ((top = find_top(sh, path, &whole)) != NULL)
+			seq = top->seq;
+		else
+			seq = LONG_MAX;
+
+		if (best == NULL || seq < best_seq) {
+			free(best);
+			best = path;
+			best_seq = seq;
+		} else {
+			free(path);
+		}
+	}
+
+	if (best == NULL)
+		return ERR_NOT_FOUND;
+	out_line(best);
+	free(best);
+	return OK;
+}
+
+/*
+ * SHARDS DESTROY: Frees every shard.
+ */
+void shards_destroy(struct Shards* sh) {
+	int k;
+
+	for (k = 0; k < sh->n; k++)
+		fs_destroy(sh->fs[k]);
+	sh->tops = ht_filter(sh->tops, drop_top, NULL);
+	if (sh->tops != NULL)
+		ht_destroy(sh->tops);
+	free(sh->fs);
+	free(sh);
+}
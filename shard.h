@@ -0,0 +1,33 @@
+/*
+ * File:	shard.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the sharded store interface.
+ */
+
+#define SHARD_SET 1
+#define SHARD_DELETE 2
+
+/************************************************
+ * SHARD OPERATION: Change of a batch.
+ * - op: SHARD_SET or SHARD_DELETE.
+ *
+ * - path: Path changed, which is overwritten.
+ *
+ * - value: Value set, unused by deletes.
+ *
+ * - status: Result of the change, once applied.
+ *************************************************/
+struct ShardOp {
+	int op;
+	char* path;
+	char* value;
+	int status;
+};
+
+struct Shards;
+
+struct Shards* shards_new(int n);
+int shards_apply(struct Shards* sh, struct ShardOp* ops, int n);
+int shards_find(struct Shards* sh, char* path);
+int shards_search(struct Shards* sh, char* value);
+void shards_destroy(struct Shards* sh);
@@ -0,0 +1,135 @@
+/*
+ * File:	snap.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Snapshot file implementation, writes snapshots to a
+ *    temporary file that only replaces the old one when complete
+ *    and maps them back into memory.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snap.h"
+
+#define TMP_SUFFIX ".tmp"
+
+/************************************************
+ * SNAPSHOT FILE:
+ * - f: Temporary file being written.
+ *
+ * - file: Name the snapshot takes once complete.
+ *
+ * - tmp: Name of the temporary file.
+ *
+ * - err: Set when a write failed.
+ *************************************************/
+struct SnapFile {
+	FILE* f;
+	char* file;
+	char* tmp;
+	int err;
+};
+
+/*
+ * SNAPSHOT CREATE: Starts writing a snapshot to
+ *    the given file, returns NULL if it can't be
+ *    created.
+ */
+struct SnapFile* snap_create(char* file) {
+	struct SnapFile* s = malloc(sizeof(struct SnapFile));
+	size_t len = strlen(file);
+
+	if (s == NULL)
+		return NULL;
+	s->tmp = malloc(len + sizeof(TMP_SUFFIX));
+	if (s->tmp == NULL) {
+		free(s);
+		return NULL;
+	}
+	memcpy(s->tmp, file, len);
+	memcpy(s->tmp + len, TMP_SUFFIX, sizeof(TMP_SUFFIX));
+
+	s->f = fopen(s->tmp, "wb");
+	if (s->f == NULL) {
+		free(s->tmp);
+		free(s);
+		return NULL;
+	}
+	s->file = file;
+	s->err = 0;
+	return s;
+}
+
+/*
+ * SNAPSHOT WRITE: Appends the given bytes to the
+ *    snapshot. Returns 0 if it fails, the
+ *    snapshot is then discarded on commit.
+ */
+int snap_write(struct SnapFile* s, void* buf, size_t n) {
+	if (!s->err && n > 0 && fwrite(buf, 1, n, s->f) != n)
+		s->err = 1;
+	return !s->err;
+}
+
+/*
+ * SNAPSHOT COMMIT: Finishes the snapshot, it is
+ *    synced to disk and then renamed over the
+ *    given file so a crash never leaves half a
+ *    snapshot behind. Returns 0 if it fails,
+ *    leaving the old file as it was.
+ */
+int snap_commit(struct SnapFile* s) {
+	int ok = !s->err && fflush(s->f) == 0 && fsync(fileno(s->f)) == 0;
+
+	if (fclose(s->f) != 0)
+		ok = 0;
+	if (ok && rename(s->tmp, s->file) != 0)
+		ok = 0;
+	if (!ok)
+		remove(s->tmp);
+
+	free(s->tmp);
+	free(s);
+	return ok;
+}
+
+/*
+ * SNAPSHOT MAP: Maps a whole snapshot file into
+ *    memory read only and stores its size.
+ *    Returns NULL if it can't be mapped.
+ */
+void* snap_map(char* file, size_t* sz) {
+	struct stat st;
+	void* map;
+	int fd = open(file, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	/* The file is read once from start to end */
+	posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+	*sz = st.st_size;
+	return map;
+}
+
+/*
+ * SNAPSHOT UNMAP: Releases a mapped snapshot.
+ */
+void snap_unmap(void* map, size_t sz) {
+	munmap(map, sz);
+}
@@ -0,0 +1,78 @@
+/*
+ * File:	snap.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the snapshot file format and the
+ *    functions to write and map snapshot files.
+ */
+
+#include <stddef.h>
+
+#define SNAP_MAGIC "FSSNAP1"
+#define SNAP_NONE -1
+
+/************************************************
+ * SNAPSHOT HEADER: Start of a snapshot file. It
+ *    is followed by the names, the values and
+ *    the directories, each as an array, and then
+ *    by the strings, every one NUL terminated.
+ *    Everything is stored in the machine's own
+ *    layout so the file can be used in place.
+ * - magic: SNAP_MAGIC.
+ *
+ * - n_dirs, n_names, n_values: Length of each
+ *    array.
+ *
+ * - next_id: ID of the next directory created.
+ *
+ * - strs_sz: Size of the strings.
+ *
+ * - log_gen: Generation of the log replayed on
+ *    the snapshot, older logs are already in it,
+ *    0 if it wasn't saved for a log.
+ *************************************************/
+struct SnapHeader {
+	char magic[8];
+	unsigned int n_dirs, n_names, n_values;
+	int next_id;
+	unsigned long strs_sz;
+	unsigned long log_gen;
+};
+
+/************************************************
+ * SNAPSHOT STRING:
+ * - off: Offset of the string in the strings.
+ *
+ * - len: Length of the string.
+ *************************************************/
+struct SnapStr {
+	unsigned long off, len;
+};
+
+/************************************************
+ * SNAPSHOT DIRECTORY: Directories are stored in
+ *    the order they're printed in, so parents
+ *    always come before their subdirectories.
+ * - id: ID of the directory.
+ *
+ * - parent: Index of the parent, SNAP_NONE for
+ *    the root.
+ *
+ * - rank: Position among its siblings ordered by
+ *    relative path.
+ *
+ * - name: Index of the relative path.
+ *
+ * - value: Index of the value, SNAP_NONE if it
+ *    has none.
+ *************************************************/
+struct SnapDir {
+	int id, parent, rank, name, value;
+};
+
+struct SnapFile;
+
+struct SnapFile* snap_create(char* file);
+int snap_write(struct SnapFile* f, void* buf, size_t n);
+int snap_commit(struct SnapFile* f);
+void* snap_map(char* file, size_t* sz);
+void snap_unmap(void* map, size_t sz);
@@ -0,0 +1,180 @@
+/*
+ * File:	sort.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Parallel sort implementation, the array is split in runs
+ *    sorted by a thread each, which are then merged in pairs, the
+ *    merges of each round also running in parallel.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "sort.h"
+
+#define MAX_RUNS 64
+#define MIN_RUN 16384
+
+/************************************************
+ * RUN: Part of the array sorted or merged by one
+ *    thread.
+ * - src, dst: Array read and array written, the
+ *    merges go back and forth between the array
+ *    and a buffer.
+ *
+ * - lo, mid, hi: The run starts at lo and ends
+ *    before hi, merges take the runs before and
+ *    after mid.
+ *
+ * - size, cmp: Size of the elements and their
+ *    order.
+ *
+ * - id: The thread.
+ *
+ * - started: Whether the thread was started.
+ *************************************************/
+struct Run {
+	char *src, *dst;
+	size_t lo, mid, hi, size;
+	int (*cmp)(const void*, const void*);
+	pthread_t id;
+	int started;
+};
+
+/*
+ * SORT RUN: Sorts a run in place.
+ */
+void* sort_run(void* arg) {
+	struct Run* r = arg;
+
+	qsort(r->src + r->lo * r->size, r->hi - r->lo, r->size, r->cmp);
+	return NULL;
+}
+
+/*
+ * MERGE RUNS: Merges two adjacent sorted runs
+ *    into the same place of the other array.
+ */
+void* merge_runs(void* arg) {
+	struct Run* r = arg;
+	char* a = r->src + r->lo * r->size;
+	char* a_end = r->src + r->mid * r->size;
+	char* b = a_end;
+	char* b_end = r->src + r->hi * r->size;
+	char* out = r->dst + r->lo * r->size;
+
+	for (; a < a_end && b < b_end; out += r->size) {
+		if (r->cmp(b, a) < 0) {
+			memcpy(out, b, r->size);
+			b += r->size;
+		} else {
+			memcpy(out, a, r->size);
+			a += r->size;
+		}
+	}
+	memcpy(out, a, a_end - a);
+	memcpy(out + (a_end - a), b, b_end - b);
+	return NULL;
+}
+
+/*
+ * COUNT RUNS: Returns in how many runs to split
+ *    an array of n elements, one per processor
+ *    as long as they aren't too short.
+ */
+int count_runs(size_t n) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t runs = n / MIN_RUN;
+
+	if (cpus > MAX_RUNS)
+		cpus = MAX_RUNS;
+	if (runs > (size_t)cpus)
+		runs = cpus;
+	return runs < 1 ? 1 : runs;
+}
+
+/*
+ * RUN ALL: Calls the function on every run, each
+ *    with a thread but the first one, which is
+ *    done by the calling thread. A thread that
+ *    can't be started is done in its place.
+ */
+void run_all(struct Run* r, int n, void* (*f)(void*)) {
+	int i;
+
+	for (i = 1; i < n; i++)
+		r[i].started = pthread_create(&r[i].id, NULL, f, &r[i]) == 0;
+	f(&r[0]);
+	for (i = 1; i < n; i++) {
+		if (r[i].started)
+			pthread_join(r[i].id, NULL);
+		else
+			f(&r[i]);
+	}
+}
+
+/*
+ * PARALLEL SORT RUNS: Sorts an array like qsort,
+ *    split in the given amount of runs, at most
+ *    MAX_RUNS and one per element. Falls back to
+ *    qsort if there is no memory for the merges.
+ */
+void psort_runs(void* base, size_t n, size_t size,
+                int (*cmp)(const void*, const void*), int runs) {
+	struct Run r[MAX_RUNS];
+	size_t bounds[MAX_RUNS + 1];
+	int i, k;
+	char *src = base, *dst, *tmp;
+
+	if (runs > MAX_RUNS)
+		runs = MAX_RUNS;
+	if ((size_t)runs > n)
+		runs = n;
+	if (runs <= 1 || (tmp = malloc(n * size)) == NULL) {
+		qsort(base, n, size, cmp);
+		return;
+	}
+
+	for (i = 0; i <= runs; i++)
+		bounds[i] = n / runs * i + (n % runs) * i / runs;
+	for (i = 0; i < runs; i++) {
+		r[i].src = src;
+		r[i].lo = bounds[i];
+		r[i].hi = bounds[i + 1];
+		r[i].size = size;
+		r[i].cmp = cmp;
+	}
+	run_all(r, runs, sort_run);
+
+	/* Every round halves the runs, a run left alone is copied over */
+	for (dst = tmp; runs > 1; runs = k) {
+		for (i = k = 0; i < runs; i += 2, k++) {
+			r[k].src = src;
+			r[k].dst = dst;
+			r[k].lo = bounds[i];
+			r[k].mid = bounds[i + 1];
+			r[k].hi = i + 2 <= runs ? bounds[i + 2] : bounds[i + 1];
+			bounds[k] = bounds[i];
+		}
+		bounds[k] = n;
+		run_all(r, k, merge_runs);
+		dst = src;
+		src = r[0].dst;
+	}
+
+	if (src != base)
+		memcpy(base, src, n * size);
+	free(tmp);
+}
+
+/*
+ * PARALLEL SORT: Sorts an array like qsort, with
+ *    the threads splitting the work when it is
+ *    long enough.
+ */
+void psort(void* base, size_t n, size_t size,
+           int (*cmp)(const void*, const void*)) {
+	psort_runs(base, n, size, cmp, count_runs(n));
+}
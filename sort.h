@@ -0,0 +1,12 @@
+/*
+ * File:	sort.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the parallel sort interface.
+ */
+
+#include <stddef.h>
+
+void psort_runs(void* base, size_t n, size_t size,
+                int (*cmp)(const void*, const void*), int runs);
+void psort(void* base, size_t n, size_t size,
+           int (*cmp)(const void*, const void*));
@@ -0,0 +1,427 @@
+/*
+ * File:	wal.c
+ * Author:	Luís Fonseca, 99266
+ * Desc:	Write-ahead log implementation, every change is appended
+ *    to a log as a checksummed record and the log is synced to disk
+ *    for a group of records at once.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "wal.h"
+
+#define HEADER_SZ 13
+#define GEN_SZ 4
+#define BUF_MIN_SZ 65536
+#define BASE_SUFFIX ".base"
+#define CRC_POLY 0xEDB88320UL
+
+/************************************************
+ * WAL: Log of the changes made since the last
+ *    snapshot. Each record is a header with the
+ *    checksum of the rest of the record, the
+ *    opcode and the lengths of the path and the
+ *    value, all little-endian, followed by the
+ *    path and the value. A log emptied by a
+ *    checkpoint starts with a WAL_GEN record
+ *    whose path is its generation, the one its
+ *    snapshot is stamped with.
+ * - fd: Log file, opened for appending.
+ *
+ * - snapshot: Snapshot the log is replayed on
+ *    top of, a file next to the log named after
+ *    it when none was given.
+ *
+ * - owned: Whether the log named the snapshot.
+ *
+ * - gen: Generation of the log, 0 until its
+ *    first checkpoint.
+ *
+ * - failed: Whether records were lost by a
+ *    write or sync that failed, every append
+ *    fails until a checkpoint succeeds.
+ *
+ * - buf: Records not yet written.
+ *
+ * - len, cap: Length and capacity of the buffer.
+ *
+ * - pending: Amount of records in the buffer.
+ *
+ * - first: Time the oldest of them was appended.
+ *
+ * - group: Records that are synced at once.
+ *
+ * - interval: Longest time, in milliseconds, a
+ *    record waits to be synced.
+ *************************************************/
+struct Wal {
+	int fd;
+	char* snapshot;
+	int owned;
+	unsigned long gen;
+	int failed;
+	char* buf;
+	size_t len, cap;
+	int pending;
+	long first;
+	int group, interval;
+};
+
+/*
+ * CRC TABLE: Remainder of every byte, filled on
+ *    first use.
+ */
+static unsigned long crc_table[256];
+
+/*
+ * CHECKSUM: Returns the CRC-32 of the given
+ *    bytes.
+ */
+unsigned long checksum(unsigned char* s, size_t n) {
+	unsigned long c = 0xFFFFFFFFUL;
+	int i, j;
+
+	if (crc_table[1] == 0) {
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = c & 1 ? CRC_POLY ^ (c >> 1) : c >> 1;
+			crc_table[i] = c;
+		}
+		c = 0xFFFFFFFFUL;
+	}
+
+	while (n-- > 0)
+		c = crc_table[(c ^ *s++) & 0xFF] ^ (c >> 8);
+	return (c ^ 0xFFFFFFFFUL) & 0xFFFFFFFFUL;
+}
+
+/*
+ * PUT U32: Stores a 32 bit number little-endian.
+ */
+void put_u32(unsigned char* s, unsigned long x) {
+	s[0] = x & 0xFF;
+	s[1] = x >> 8 & 0xFF;
+	s[2] = x >> 16 & 0xFF;
+	s[3] = x >> 24 & 0xFF;
+}
+
+/*
+ * GET U32: Reads a 32 bit little-endian number.
+ */
+unsigned long get_u32(unsigned char* s) {
+	return (unsigned long)s[0] | (unsigned long)s[1] << 8 |
+	       (unsigned long)s[2] << 16 | (unsigned long)s[3] << 24;
+}
+
+/*
+ * NOW: Returns the time in milliseconds.
+ */
+long now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/*
+ * WRITE FULLY: Writes the given bytes to a file.
+ *    Returns 0 if it fails.
+ */
+int write_fully(int fd, char* s, size_t n) {
+	ssize_t w;
+
+	while (n > 0) {
+		w = write(fd, s, n);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			return 0;
+		s += w;
+		n -= w;
+	}
+	return 1;
+}
+
+/*
+ * PUT RECORD: Stores a record with the given
+ *    opcode, path and value, which can be NULL,
+ *    with room for it in rec.
+ */
+void put_record(unsigned char* rec, int op, char* path, size_t path_len,
+                                           char* value, size_t value_len) {
+	rec[4] = op;
+	put_u32(rec + 5, path_len);
+	put_u32(rec + 9, value_len);
+	memcpy(rec + HEADER_SZ, path, path_len);
+	if (value_len > 0)
+		memcpy(rec + HEADER_SZ + path_len, value, value_len);
+	put_u32(rec, checksum(rec + 4, HEADER_SZ - 4 + path_len + value_len));
+}
+
+/*
+ * RESET LOG: Empties the log and starts it with
+ *    the record of the given generation. Returns
+ *    0 if it fails, the log is then marked
+ *    failed.
+ */
+int reset_log(struct Wal* w, unsigned long gen) {
+	unsigned char rec[HEADER_SZ + GEN_SZ];
+	unsigned char g[GEN_SZ];
+
+	put_u32(g, gen);
+	put_record(rec, WAL_GEN, (char*)g, GEN_SZ, NULL, 0);
+	w->len = 0;
+	w->pending = 0;
+
+	w->failed = ftruncate(w->fd, 0) != 0 ||
+	            !write_fully(w->fd, (char*)rec, sizeof(rec)) || fsync(w->fd) != 0;
+	if (!w->failed)
+		w->gen = gen;
+	return !w->failed;
+}
+
+/*
+ * WAL OPEN: Opens the log in the given file,
+ *    creating it if needed. Records are synced in
+ *    groups of the given size, or once the oldest
+ *    waited for the given interval. The log is
+ *    replayed on top of the given snapshot, or of
+ *    its own if NULL. Returns NULL if it can't be
+ *    opened.
+ */
+struct Wal* wal_open(char* file, char* snapshot, int group, int interval) {
+	struct Wal* w = malloc(sizeof(struct Wal));
+	if (w == NULL)
+		return NULL;
+
+	w->owned = snapshot == NULL;
+	if (w->owned) {
+		snapshot = malloc(strlen(file) + sizeof(BASE_SUFFIX));
+		if (snapshot == NULL) {
+			free(w);
+			return NULL;
+		}
+		strcat(strcpy(snapshot, file), BASE_SUFFIX);
+	}
+
+	w->fd = open(file, O_RDWR | O_APPEND | O_CREAT, 0644);
+	if (w->fd < 0) {
+		if (w->owned)
+			free(snapshot);
+		free(w);
+		return NULL;
+	}
+	w->snapshot = snapshot;
+	w->gen = 0;
+	w->failed = 0;
+	w->buf = NULL;
+	w->len = w->cap = 0;
+	w->pending = 0;
+	w->first = 0;
+	w->group = group > 0 ? group : 1;
+	w->interval = interval;
+	return w;
+}
+
+/*
+ * READ LOG: Reads the whole log into a buffer
+ *    and stores its size. Returns NULL if it
+ *    fails.
+ */
+char* read_log(struct Wal* w, size_t* sz) {
+	struct stat st;
+	char* log;
+	size_t n = 0;
+	ssize_t r;
+
+	if (fstat(w->fd, &st) != 0)
+		return NULL;
+	log = malloc(st.st_size + 1);
+	if (log == NULL)
+		return NULL;
+
+	while (n < (size_t)st.st_size) {
+		r = pread(w->fd, log + n, st.st_size - n, n);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			free(log);
+			return NULL;
+		}
+		n += r;
+	}
+
+	*sz = n;
+	return log;
+}
+
+/*
+ * WAL REPLAY: Gives every record of the log to
+ *    the apply function, with the opcode, the
+ *    path and the value, which is NULL if there
+ *    is none, on top of a snapshot stamped with
+ *    the given generation. A log of an older
+ *    generation was already saved in it by a
+ *    checkpoint that stopped before emptying the
+ *    log, so it is emptied instead. A torn or
+ *    corrupt record ends the log, it is cut
+ *    there so new records follow the last good
+ *    one. Returns 0 if it fails or apply does.
+ */
+int wal_replay(struct Wal* w, unsigned long gen,
+               int (*apply)(int, char*, char*, void*), void* extra) {
+	unsigned char* rec;
+	unsigned long path_len, value_len;
+	char *path, *value, *scratch;
+	size_t sz, off = 0;
+	char* log = read_log(w, &sz);
+	int ok = 1;
+
+	if (log == NULL || (scratch = malloc(sz + 2)) == NULL) {
+		free(log);
+		return 0;
+	}
+
+	while (ok && sz - off >= HEADER_SZ) {
+		rec = (unsigned char*)log + off;
+		path_len = get_u32(rec + 5);
+		value_len = get_u32(rec + 9);
+		if (path_len > sz - off - HEADER_SZ ||
+		    value_len > sz - off - HEADER_SZ - path_len ||
+		    checksum(rec + 4, HEADER_SZ - 4 + path_len + value_len) !=
+		                                                   get_u32(rec))
+			break;
+
+		/* The strings are copied out to be terminated */
+		path = scratch;
+		memcpy(path, rec + HEADER_SZ, path_len);
+		path[path_len] = '\0';
+		value = path + path_len + 1;
+		memcpy(value, rec + HEADER_SZ + path_len, value_len);
+		value[value_len] = '\0';
+
+		if (rec[4] == WAL_GEN && off == 0 && path_len == GEN_SZ)
+			w->gen = get_u32(rec + HEADER_SZ);
+		if (w->gen < gen)
+			break;
+		if (rec[4] != WAL_GEN)
+			ok = apply(rec[4], path, value_len > 0 ? value : NULL, extra);
+		off += HEADER_SZ + path_len + value_len;
+	}
+
+	if (ok && w->gen < gen)
+		ok = reset_log(w, gen);
+	else if (ok && off < sz && ftruncate(w->fd, off) != 0)
+		ok = 0;
+	free(scratch);
+	free(log);
+	return ok;
+}
+
+/*
+ * WAL APPEND: Appends a record with the given
+ *    opcode, path and value, which can be NULL.
+ *    The group is synced once it's full or its
+ *    oldest record waited long enough. Returns 0
+ *    if it fails to allocate memory or to sync,
+ *    or if the log failed before.
+ */
+int wal_append(struct Wal* w, int op, char* path, char* value) {
+	size_t path_len = strlen(path);
+	size_t value_len = value != NULL ? strlen(value) : 0;
+	size_t n = HEADER_SZ + path_len + value_len;
+	size_t cap = w->cap > 0 ? w->cap : BUF_MIN_SZ;
+	unsigned char* rec;
+	char* buf;
+
+	/* Records after a lost one would replay over a gap */
+	if (w->failed)
+		return 0;
+
+	if (w->len + n > w->cap) {
+		while (cap < w->len + n)
+			cap *= 2;
+		buf = realloc(w->buf, cap);
+		if (buf == NULL)
+			return 0;
+		w->buf = buf;
+		w->cap = cap;
+	}
+
+	rec = (unsigned char*)w->buf + w->len;
+	put_record(rec, op, path, path_len, value, value_len);
+	w->len += n;
+
+	if (w->pending++ == 0)
+		w->first = now();
+	if (w->pending >= w->group || now() - w->first >= w->interval)
+		return wal_commit(w);
+	return 1;
+}
+
+/*
+ * WAL COMMIT: Writes the records appended so far
+ *    and syncs them to disk. Returns 0 if it
+ *    fails, the records are then lost and the
+ *    log is marked failed.
+ */
+int wal_commit(struct Wal* w) {
+	if (w->pending == 0)
+		return 1;
+
+	w->failed = !write_fully(w->fd, w->buf, w->len) || fdatasync(w->fd) != 0;
+	w->len = 0;
+	w->pending = 0;
+	return !w->failed;
+}
+
+/*
+ * WAL BASE: Returns the snapshot the log is
+ *    replayed on top of, or NULL if it's the
+ *    log's own and it was never saved.
+ */
+char* wal_base(struct Wal* w) {
+	return w->owned && access(w->snapshot, F_OK) != 0 ? NULL : w->snapshot;
+}
+
+/*
+ * WAL IS BASE: Returns true if the given file is
+ *    the snapshot the log is replayed on.
+ */
+int wal_is_base(struct Wal* w, char* file) {
+	return strcmp(w->snapshot, file) == 0;
+}
+
+/*
+ * WAL CHECKPOINT: Saves the state with the given
+ *    function as the snapshot the log is replayed
+ *    on, stamped with the next generation, and
+ *    empties the log into that generation. The
+ *    snapshot holds every record, so a crash in
+ *    between leaves an older log that replay
+ *    skips. Returns 0 if it fails.
+ */
+int wal_checkpoint(struct Wal* w, int (*save)(char*, unsigned long, void*),
+                                                         void* extra) {
+	return save(w->snapshot, w->gen + 1, extra) && reset_log(w, w->gen + 1);
+}
+
+/*
+ * WAL CLOSE: Syncs the records left and closes
+ *    the log.
+ */
+void wal_close(struct Wal* w) {
+	wal_commit(w);
+	close(w->fd);
+	if (w->owned)
+		free(w->snapshot);
+	free(w->buf);
+	free(w);
+}
@@ -0,0 +1,22 @@
+/*
+ * File:	wal.h
+ * Author:	Luís Fonseca, 99266
+ * Desc:	This header exposes the write-ahead log interface.
+ */
+
+#define WAL_SET 1
+#define WAL_DELETE 2
+#define WAL_GEN 3
+
+struct Wal;
+
+struct Wal* wal_open(char* file, char* snapshot, int group, int interval);
+int wal_replay(struct Wal* w, unsigned long gen,
+               int (*apply)(int, char*, char*, void*), void* extra);
+int wal_append(struct Wal* w, int op, char* path, char* value);
+int wal_commit(struct Wal* w);
+char* wal_base(struct Wal* w);
+int wal_is_base(struct Wal* w, char* file);
+int wal_checkpoint(struct Wal* w, int (*save)(char*, unsigned long, void*),
+                                                         void* extra);
+void wal_close(struct Wal* w);